@@ -149,6 +149,12 @@ bool ALSA::open(const char *deviceName, unsigned int rate, unsigned int bufferSi
   return(true);
 }
 
+unsigned int ALSA::getAvail() const
+{
+  snd_pcm_sframes_t avail = handle? snd_pcm_avail(handle) : 0;
+  return(avail>0? avail : 0);
+}
+
 unsigned int ALSA::read(void *data, unsigned int samples)
 {
   unsigned int count;
@@ -171,10 +177,12 @@ unsigned int ALSA::read(void *data, unsigned int samples)
     }
     else if(res==-EPIPE)
     {
+      if(metrics) metrics->count(Metrics::ALSA_XRUNS);
       res = snd_pcm_prepare(handle);
     }
     else if(res==-ESTRPIPE)
     {
+      if(metrics) metrics->count(Metrics::ALSA_SUSPENDS);
       // Wait until suspend flag is released
       while((res=snd_pcm_resume(handle))==-EAGAIN) sleep(1);
       res = snd_pcm_prepare(handle);
@@ -183,6 +191,12 @@ unsigned int ALSA::read(void *data, unsigned int samples)
     if(res<0) fprintf(stderr, "ALSA::read(): %s (%d)\n", snd_strerror(res), res);
   }
 
+  if(metrics)
+  {
+    metrics->count(Metrics::FRAMES_CAPTURED, count);
+    if(count<samples) metrics->count(Metrics::FRAMES_DROPPED, samples - count);
+  }
+
 //  fprintf(stderr, "@@@ Reading %d (/%lu) frames to %p => got %d\n", samples, periodSize, data, count);
 
   // Done
@@ -1,29 +1,39 @@
 #ifndef ALSA_HPP
 #define ALSA_HPP
 
+#include "Metrics.hpp"
 #include <alsa/asoundlib.h>
 
 class ALSA
 {
   public:
     ALSA(): handle(0) {}
-    ~ALSA() { close(); }
+    virtual ~ALSA() { close(); }
 
-    bool open(const char *deviceName, unsigned int rate, unsigned int bufferSize, unsigned int periodSize);
+    virtual bool open(const char *deviceName, unsigned int rate, unsigned int bufferSize, unsigned int periodSize);
       // Open given ALSA device.
 
-    void close();
+    virtual void close();
       // Close previously open ALSA device.
 
-    bool isOpen() const { return(!!handle); }
+    virtual bool isOpen() const { return(!!handle); }
       // Check if device is open.
 
-    unsigned int read(void *data, unsigned int samples);
+    virtual unsigned int read(void *data, unsigned int samples);
       // Read given number of samples from the open device.
 
-    unsigned int getChunkSize() const { return(periodSize); }
+    virtual unsigned int getChunkSize() const { return(periodSize); }
       // Return current chunk size.
 
+    virtual unsigned int getAvail() const;
+      // Return number of captured samples not read yet.
+
+    void setMetrics(Metrics *metrics) { this->metrics = metrics; }
+      // Collect capture statistics into given metrics.
+
+  protected:
+    Metrics *metrics = 0;
+
   private:
     snd_pcm_t *handle;
     unsigned int rate;
@@ -0,0 +1,108 @@
+#include "ActivityDetector.hpp"
+#include "Kernels.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+void ActivityDetector::configure(double threshold, double flatness, unsigned int hangMs, unsigned int decimation)
+{
+  this->threshold     = threshold;
+  this->flatnessLimit = flatness;
+  this->hangMs        = hangMs;
+  this->decimation    = std::max(1U, decimation);
+
+  // Allocate everything here, process() must not allocate
+  fft.setSize(FFT_SIZE);
+  spectrum.resize(FFT_SIZE);
+  power.assign(FFT_SIZE, 0.0f);
+
+  reset();
+}
+
+void ActivityDetector::reset()
+{
+  std::fill(power.begin(), power.end(), 0.0f);
+  filled       = 0;
+  energy       = 0.0;
+  floor        = 0.0;
+  flatness     = 1.0;
+  active       = false;
+  hang         = 0;
+  activeBlocks = 0;
+  totalBlocks  = 0;
+}
+
+bool ActivityDetector::process(const short *data, unsigned int samples, unsigned int rate)
+{
+  const Kernels::Table &kernels = Kernels::get();
+  unsigned int spectra = 0;
+  double sum = 0.0;
+  unsigned int count = samples / decimation;
+
+  std::fill(power.begin(), power.end(), 0.0f);
+
+  // Decimate by averaging, accumulating power spectra of decimated data
+  for(unsigned int j=0, n ; j<count ; j+=n)
+  {
+    std::complex<float> *v = spectrum.data() + filled;
+    n = std::min(count - j, FFT_SIZE - filled);
+
+    kernels.average(data + 2 * j * decimation, n, decimation, reinterpret_cast<float *>(v));
+    for(unsigned int k=0 ; k<n ; ++k) sum += std::norm(v[k]);
+
+    filled += n;
+    if(filled==FFT_SIZE)
+    {
+      fft.transform(spectrum.data());
+      kernels.power(reinterpret_cast<const float *>(spectrum.data()), FFT_SIZE, power.data());
+      filled = 0;
+      ++spectra;
+    }
+  }
+
+  if(!count) return(active);
+
+  // Block energy in dBFS, noise floor follows drops at once and rises slowly
+  energy = 10.0 * log10(sum / count + 1e-20);
+  if(!totalBlocks || (energy < floor)) floor = energy;
+  else if(!active) floor += (energy - floor) * 0.01;
+
+  // Spectral flatness: geometric over arithmetic mean of power
+  if(spectra)
+  {
+    double logSum = 0.0, linSum = 0.0;
+    for(unsigned int k=0 ; k<FFT_SIZE ; ++k)
+    {
+      logSum += log(power[k] + 1e-20);
+      linSum += power[k];
+    }
+
+    flatness = exp(logSum / FFT_SIZE) / (linSum / FFT_SIZE + 1e-20);
+  }
+
+  // Trigger on energy or on structure in the spectrum, then hold
+  unsigned long long hangSamples = (unsigned long long)hangMs * rate / 1000;
+  if((energy > floor + threshold) || (flatness < flatnessLimit)) hang = hangSamples + samples;
+
+  active = hang > 0;
+  hang   = hang > samples? hang - samples : 0;
+
+  totalBlocks++;
+  if(active) activeBlocks++;
+
+  return(active);
+}
+
+std::string ActivityDetector::getStatus() const
+{
+  char buf[256];
+
+  snprintf(buf, sizeof(buf),
+    "active=%s\nenergy=%.1fdBFS\nfloor=%.1fdBFS\nflatness=%.3f\nactiveRatio=%.3f\n",
+    active? "true":"false", energy, floor, flatness,
+    totalBlocks? (double)activeBlocks / totalBlocks : 0.0
+  );
+
+  return(buf);
+}
@@ -0,0 +1,60 @@
+#ifndef ACTIVITYDETECTOR_HPP
+#define ACTIVITYDETECTOR_HPP
+
+#include "FFT.hpp"
+#include <complex>
+#include <string>
+#include <vector>
+
+class ActivityDetector
+{
+  public:
+    static const unsigned int FFT_SIZE = 64;
+      // Spectrum size used for flatness measurement.
+
+    ActivityDetector() { configure(); }
+
+    void configure(double threshold = 10.0, double flatness = 0.5, unsigned int hangMs = 500, unsigned int decimation = 16);
+      // Signal is active when energy rises THRESHOLD dB above noise floor,
+      // or spectral flatness drops below FLATNESS (1.0 being white noise).
+      // Activity is held for HANGMS after the last trigger. Detection runs
+      // on data decimated by DECIMATION.
+
+    bool process(const short *data, unsigned int samples, unsigned int rate);
+      // Analyze CS16 samples, return TRUE if signal is active.
+
+    void reset();
+      // Forget noise floor and statistics.
+
+    bool isActive() const { return(active); }
+      // Get last decision.
+
+    std::string getStatus() const;
+      // Print detector state and statistics, one value per line.
+
+    double getThreshold() const { return(threshold); }
+    double getFlatness() const { return(flatnessLimit); }
+    unsigned int getHang() const { return(hangMs); }
+    unsigned int getDecimation() const { return(decimation); }
+
+  private:
+    double threshold;
+    double flatnessLimit;
+    unsigned int hangMs;
+    unsigned int decimation;
+
+    FFT fft;
+    std::vector<std::complex<float>> spectrum;
+    std::vector<float> power;
+    unsigned int filled;
+
+    double energy;
+    double floor;
+    double flatness;
+    bool active;
+    unsigned long long hang;
+    unsigned long long activeBlocks;
+    unsigned long long totalBlocks;
+};
+
+#endif // ACTIVITYDETECTOR_HPP
@@ -0,0 +1,73 @@
+#include "BufferPool.hpp"
+#include "RealTime.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+bool BufferPool::reserve(size_t size, bool hugePages)
+{
+  used = 0;
+
+  // Keep current arena if it is large enough
+  if(data && (size<=this->size) && (hugePages==huge)) return(true);
+  release();
+  if(!size) return(true);
+
+  // Huge pages need arena aligned to and sized in whole huge pages
+  size_t align = hugePages? HUGE_PAGE : sysconf(_SC_PAGESIZE);
+  size = (size + align - 1) / align * align;
+
+  unsigned char *area = (unsigned char *)mmap(0, size + align, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(area==MAP_FAILED)
+  {
+    fprintf(stderr, "BufferPool::reserve(): Failed allocating %zu bytes!\n", size);
+    return(false);
+  }
+
+  // Trim unaligned head and excess tail
+  unsigned char *start = (unsigned char *)(((uintptr_t)area + align - 1) / align * align);
+  if(start>area) munmap(area, start - area);
+  if(start+size < area+size+align) munmap(start + size, area + size + align - start - size);
+
+  data = start;
+  this->size = size;
+  huge = hugePages;
+
+  // Ask kernel for transparent huge pages, fall back to small ones
+  if(huge && (madvise(data, size, MADV_HUGEPAGE)<0))
+    fprintf(stderr, "BufferPool::reserve(): Transparent huge pages not available.\n");
+
+  return(true);
+}
+
+void *BufferPool::get(size_t size)
+{
+  size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+  if(!data || (used+size > this->size))
+  {
+    fprintf(stderr, "BufferPool::get(): Pool exhausted (%zu + %zu > %zu bytes)!\n", used, size, this->size);
+    return(0);
+  }
+
+  void *result = data + used;
+  used += size;
+  return(result);
+}
+
+void BufferPool::release()
+{
+  if(data) munmap(data, size);
+  data = 0;
+  size = 0;
+  used = 0;
+  huge = false;
+}
+
+bool BufferPool::lock()
+{
+  return(RealTime::lockMemory(data, size));
+}
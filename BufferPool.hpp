@@ -0,0 +1,48 @@
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+#include <stddef.h>
+
+class BufferPool
+{
+  public:
+    static const size_t ALIGNMENT = 64;
+      // Alignment of buffers returned by get(), a cache line.
+    static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+      // Transparent huge page size.
+
+    BufferPool() {}
+    ~BufferPool() { release(); }
+
+    bool reserve(size_t size, bool hugePages = false);
+      // Make sure arena holds at least given number of bytes,
+      // reallocating it only if it is too small. Forgets all buffers.
+
+    void *get(size_t size);
+      // Carve an aligned buffer out of the arena, 0 if it is exhausted.
+
+    template<typename T> T *get(size_t count)
+    { return(static_cast<T *>(get(count * sizeof(T)))); }
+      // Carve an aligned array of given type out of the arena.
+
+    void clear() { used = 0; }
+      // Forget all buffers, keeping the arena.
+
+    void release();
+      // Free the arena.
+
+    bool lock();
+      // Lock the arena into RAM.
+
+    size_t getSize() const { return(size); }
+    size_t getUsed() const { return(used); }
+    bool isHuge() const { return(huge); }
+
+  private:
+    unsigned char *data = 0;
+    size_t size = 0;
+    size_t used = 0;
+    bool huge = false;
+};
+
+#endif // BUFFERPOOL_HPP
@@ -0,0 +1,53 @@
+#include "CRC16.hpp"
+
+unsigned short CRC16::table[8][256];
+bool CRC16::initialized = CRC16::initialize();
+
+bool CRC16::initialize()
+{
+  // Table 0 is the regular byte-at-a-time table
+  for(unsigned int j=0 ; j<256 ; ++j)
+  {
+    unsigned short crc = j;
+    for(unsigned int i=0 ; i<8 ; ++i)
+      crc = (crc >> 1) ^ (crc&1? 0xA001 : 0);
+    table[0][j] = crc;
+  }
+
+  // Table K applies a byte followed by K zero bytes
+  for(unsigned int k=1 ; k<8 ; ++k)
+    for(unsigned int j=0 ; j<256 ; ++j)
+      table[k][j] = (table[k-1][j] >> 8) ^ table[0][table[k-1][j] & 0xFF];
+
+  return(true);
+}
+
+unsigned short CRC16::compute(const unsigned char *data, unsigned int length, unsigned short crc)
+{
+  // Process eight bytes at a time
+  for( ; length>=8 ; data+=8, length-=8)
+  {
+    crc ^= data[0] | (data[1] << 8);
+    crc = table[7][crc & 0xFF] ^ table[6][crc >> 8]
+        ^ table[5][data[2]] ^ table[4][data[3]]
+        ^ table[3][data[4]] ^ table[2][data[5]]
+        ^ table[1][data[6]] ^ table[0][data[7]];
+  }
+
+  // Process remaining bytes
+  for( ; length ; ++data, --length)
+    crc = (crc >> 8) ^ table[0][(crc ^ *data) & 0xFF];
+
+  return(crc);
+}
+
+unsigned short CRC16::computeBitwise(const unsigned char *data, unsigned int length, unsigned short crc)
+{
+  unsigned int i, j;
+
+  for(i = 0; i < length; i++)
+    for (j = 0, crc ^= data[i]; j < 8; j++)
+      crc = (crc >> 1) ^ (crc&1? 0xA001 : 0);
+
+  return crc;
+}
@@ -0,0 +1,19 @@
+#ifndef CRC16_HPP
+#define CRC16_HPP
+
+class CRC16
+{
+  public:
+    static unsigned short compute(const unsigned char *data, unsigned int length, unsigned short crc = 0xFFFF);
+      // Compute CRC16 (polynomial 0xA001) eight bytes at a time.
+
+    static unsigned short computeBitwise(const unsigned char *data, unsigned int length, unsigned short crc = 0xFFFF);
+      // Compute CRC16 one bit at a time (reference implementation).
+
+  private:
+    static unsigned short table[8][256];
+    static bool initialize();
+    static bool initialized;
+};
+
+#endif // CRC16_HPP
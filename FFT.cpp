@@ -0,0 +1,52 @@
+#include "FFT.hpp"
+
+#include <math.h>
+
+bool FFT::setSize(unsigned int size)
+{
+  unsigned int bits;
+
+  // Size must be a power of two
+  if(!size || (size & (size-1))) return(false);
+  for(bits=0 ; (1U<<bits)<size ; ++bits);
+
+  this->size = size;
+
+  // Precompute twiddle factors
+  twiddles.resize(size/2);
+  for(unsigned int j=0 ; j<size/2 ; ++j)
+    twiddles[j] = std::polar(1.0f, (float)(-2.0 * M_PI * j / size));
+
+  // Precompute bit-reversed indices
+  reversed.resize(size);
+  for(unsigned int j=0 ; j<size ; ++j)
+  {
+    unsigned int r = 0;
+    for(unsigned int i=0 ; i<bits ; ++i) r |= ((j>>i) & 1) << (bits-1-i);
+    reversed[j] = r;
+  }
+
+  return(true);
+}
+
+void FFT::transform(std::complex<float> *data) const
+{
+  // Reorder input
+  for(unsigned int j=0 ; j<size ; ++j)
+    if(j<reversed[j]) std::swap(data[j], data[reversed[j]]);
+
+  // Radix-2 butterflies
+  for(unsigned int len=2 ; len<=size ; len<<=1)
+  {
+    unsigned int half = len/2;
+    unsigned int step = size/len;
+
+    for(unsigned int j=0 ; j<size ; j+=len)
+      for(unsigned int i=0 ; i<half ; ++i)
+      {
+        std::complex<float> t = data[j+i+half] * twiddles[i*step];
+        data[j+i+half] = data[j+i] - t;
+        data[j+i]     += t;
+      }
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include <complex>
+#include <vector>
+
+class FFT
+{
+  public:
+    FFT(unsigned int size = 1024) { setSize(size); }
+
+    bool setSize(unsigned int size);
+      // Set FFT size, must be a power of two.
+
+    unsigned int getSize() const { return(size); }
+      // Get current FFT size.
+
+    void transform(std::complex<float> *data) const;
+      // Perform in-place forward FFT.
+
+  private:
+    unsigned int size;
+    std::vector<std::complex<float>> twiddles;
+    std::vector<unsigned int> reversed;
+};
+
+#endif // FFT_HPP
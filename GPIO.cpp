@@ -13,6 +13,8 @@
 #define GPIOD_BUSY_LINE     5
 #endif
 
+const char *GPIO::DEFAULT_CHIP = "gpiochip0";
+
 void GPIO::uninitialize()
 {
   if(chip)
@@ -27,15 +29,46 @@ bool GPIO::waitForSTM() const
   // Must have GPIO lines
   if(!chip) return(false);
 
-  // Wait for STM chip to become ready
-  for(int j = 0 ; j < 10000 ; j++)
-    if(gpiod_line_get_value(busy_line)) usleep(1000); else return(true);
+  unsigned long long start = Metrics::now();
+
+  if(busyEvents)
+  {
+    // Wait for falling edges on the BUSY line, for up to 10 seconds. Edges
+    // are queued by the kernel, so an edge occurring between reading the
+    // line and waiting for it cannot be missed. Stale edges just cause
+    // another check.
+    while(Metrics::now() - start < 10000000)
+    {
+      if(!gpiod_line_get_value(busy_line))
+      {
+        if(metrics) metrics->time(Metrics::STM_WAIT, Metrics::now() - start);
+        return(true);
+      }
+
+      struct timespec timeout = { 0, 10000000 };
+      struct gpiod_line_event event;
+      if(gpiod_line_event_wait(busy_line, &timeout) > 0)
+        gpiod_line_event_read(busy_line, &event);
+    }
+  }
+  else
+  {
+    // Wait for STM chip to become ready
+    for(int j = 0 ; j < 10000 ; j++)
+      if(gpiod_line_get_value(busy_line)) usleep(1000);
+      else
+      {
+        if(metrics) metrics->time(Metrics::STM_WAIT, Metrics::now() - start);
+        return(true);
+      }
+  }
 
   // Timeout
+  if(metrics) metrics->count(Metrics::STM_TIMEOUTS);
   return(false);
 }
 
-bool GPIO::initialize(const char *chipName)
+bool GPIO::initialize(const char *chipName, int rstLine, int busyLine)
 {
   // Uninitialize first
   uninitialize();
@@ -51,7 +84,7 @@ bool GPIO::initialize(const char *chipName)
 
   fprintf(stderr, "GPIO::initialize(): Requesting GPIO lines...\n");
 
-  rst_line = gpiod_chip_get_line(chip, GPIOD_RST_LINE);
+  rst_line = gpiod_chip_get_line(chip, rstLine<0? GPIOD_RST_LINE : rstLine);
   if(!rst_line)
   {
     fprintf(stderr, "GPIO::initialize(): Failed obtaining RST GPIO line\n");
@@ -59,14 +92,15 @@ bool GPIO::initialize(const char *chipName)
     return(false);
   }
 
-  if(gpiod_line_request_output(rst_line, "master", 0) < 0)
+  // Keep RST released, so that opening lines does not reset a running STM
+  if(gpiod_line_request_output(rst_line, "master", 1) < 0)
   {
     fprintf(stderr, "GPIO::initialize(): Failed setting RST GPIO line as output\n");
     uninitialize();
     return(false);
   }
 
-  busy_line = gpiod_chip_get_line(chip, GPIOD_BUSY_LINE);
+  busy_line = gpiod_chip_get_line(chip, busyLine<0? GPIOD_BUSY_LINE : busyLine);
   if(!busy_line)
   {
     fprintf(stderr, "GPIO::initialize(): Failed obtaining BUSY GPIO line\n");
@@ -74,11 +108,18 @@ bool GPIO::initialize(const char *chipName)
     return(false);
   }
 
-  if(gpiod_line_request_input(busy_line, "master") < 0)
+  // Prefer edge events on the BUSY line, fall back to polling
+  busyEvents = gpiod_line_request_falling_edge_events(busy_line, "master") >= 0;
+  if(!busyEvents)
   {
-    fprintf(stderr, "GPIO::initialize(): Failed setting BUSY GPIO line as input\n");
-    uninitialize();
-    return(false);
+    fprintf(stderr, "GPIO::initialize(): No BUSY GPIO line events, polling instead\n");
+
+    if(gpiod_line_request_input(busy_line, "master") < 0)
+    {
+      fprintf(stderr, "GPIO::initialize(): Failed setting BUSY GPIO line as input\n");
+      uninitialize();
+      return(false);
+    }
   }
 
   // Success
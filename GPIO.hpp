@@ -1,13 +1,17 @@
 #ifndef GPIO_HPP
 #define GPIO_HPP
 
+#include "Metrics.hpp"
 #include <gpiod.h>
 
 class GPIO
 {
   public:
-    GPIO(const char *chipName = "gpiochip0")
-    { initialize(chipName); }
+    static const char *DEFAULT_CHIP;
+
+    GPIO(const char *chipName = DEFAULT_CHIP, int rstLine = -1, int busyLine = -1)
+    { initialize(chipName, rstLine, busyLine); }
+      // Negative line numbers select default lines.
 
     ~GPIO()
     { uninitialize(); }
@@ -18,15 +22,25 @@ class GPIO
     bool waitForSTM() const;
       // Wait until STM becomes ready.
 
+    bool isReady() const
+    { return(chip && !gpiod_line_get_value(busy_line)); }
+      // Check if STM is ready right now.
+
+    void setMetrics(Metrics *metrics) { this->metrics = metrics; }
+      // Collect wait times into given metrics.
+
   private:
     struct gpiod_chip *chip = 0;
+    Metrics *metrics = 0;
 
     gpiod_line *rst_line;
 
-    bool initialize(const char *chipName);
+    bool initialize(const char *chipName, int rstLine, int busyLine);
     void uninitialize();
 
     gpiod_line *busy_line;
+    bool busyEvents = false;
+      // TRUE: BUSY line delivers falling edge events.
 };
 
 #endif // GPIO_HPP
@@ -0,0 +1,290 @@
+#include "History.hpp"
+#include "IQCodec.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+
+static long long wallClock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return((long long)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+bool History::configure(size_t bytes, unsigned int format, unsigned int blockSize, bool hugePages)
+{
+  // Abort snapshot in progress, it reads the ring
+  if(writer.joinable())
+  {
+    stopping = true;
+    writer.join();
+    stopping = false;
+  }
+
+  std::lock_guard <std::mutex> lock(mutex);
+
+  first = next = pos = 0;
+  this->format = format;
+
+  if(!bytes)
+  {
+    ring = 0;
+    size = 0;
+    records.clear();
+    pool.release();
+    return(true);
+  }
+
+  if(!pool.reserve(bytes, hugePages))
+  {
+    fprintf(stderr, "History::configure(): Failed allocating %zu bytes!\n", bytes);
+    ring = 0;
+    size = 0;
+    return(false);
+  }
+
+  // Index enough records for blocks compressing down to 1 byte/sample
+  ring = pool.get<unsigned char>(bytes);
+  size = bytes;
+  records.resize(bytes / std::max(1U, blockSize) + 16);
+  return(true);
+}
+
+void History::write(const short *data, unsigned int samples, unsigned int rate, long long timeNs, double frequency, bool active)
+{
+  std::lock_guard <std::mutex> lock(mutex);
+  size_t need = format==FORMAT_LOSSLESS? IQCodec::getMaxSize(samples) : samples * 2 * sizeof(short);
+
+  if(!size || (need > size)) return;
+
+  // Wrap around, dropping the oldest records left past the write position
+  if(pos + need > size)
+  {
+    while((first<next) && (records[first % records.size()].offset >= pos)) ++first;
+    pos = 0;
+  }
+
+  // Drop records about to be overwritten, or not fitting the index
+  while(first<next)
+  {
+    const Record &r = records[first % records.size()];
+    if((next - first < records.size()) && ((r.offset < pos) || (r.offset >= pos + need))) break;
+    ++first;
+  }
+
+  Record &r = records[next % records.size()];
+  r.offset    = pos;
+  r.samples   = samples;
+  r.rate      = rate;
+  r.timeNs    = timeNs;
+  r.wallNs    = wallClock() - (long long)(samples * 1000000000.0 / rate);
+  r.frequency = frequency;
+  r.active    = active;
+
+  if(format==FORMAT_LOSSLESS)
+    r.bytes = IQCodec::encode(data, samples, ring + pos);
+  else
+  {
+    memcpy(ring + pos, data, need);
+    r.bytes = need;
+  }
+
+  pos += r.bytes;
+  ++next;
+}
+
+double History::getSeconds() const
+{
+  std::lock_guard <std::mutex> lock(mutex);
+  double result = 0.0;
+
+  for(unsigned long long j=first ; j<next ; ++j)
+    result += (double)records[j % records.size()].samples / records[j % records.size()].rate;
+
+  return(result);
+}
+
+bool History::snapshot(const std::string &path, double postSeconds)
+{
+  if(writing)
+  {
+    fprintf(stderr, "History::snapshot(): Snapshot already in progress!\n");
+    return(false);
+  }
+
+  if(writer.joinable()) writer.join();
+
+  std::lock_guard <std::mutex> lock(mutex);
+  if(first==next) return(false);
+
+  // Take everything held now, plus samples arriving in the next POSTSECONDS
+  const Record &last = records[(next - 1) % records.size()];
+  long long endNs = last.timeNs + (long long)((last.samples / (double)last.rate + postSeconds) * 1000000000.0);
+
+  snapshotStatus = "writing " + path;
+  writing = true;
+  writer  = std::thread(&History::writeSnapshot, this, path, first, endNs);
+  return(true);
+}
+
+void History::writeSnapshot(std::string path, unsigned long long start, long long endNs)
+{
+  struct Capture
+  {
+    unsigned long long start;
+    double frequency;
+    long long wallNs;
+  };
+
+  std::vector<unsigned char> block;
+  std::vector<short> samples;
+  std::vector<Capture> captures;
+  std::vector<std::pair<unsigned long long, unsigned long long>> active;
+  unsigned long long count = 0, lost = 0;
+  unsigned int rate = 0;
+  double frequency = 0.0;
+  long long expectNs = 0;
+  auto progress = std::chrono::steady_clock::now();
+  char buf[256];
+
+  FILE *f = fopen((path + ".sigmf-data").c_str(), "wb");
+  if(!f)
+  {
+    fprintf(stderr, "History::writeSnapshot(): Failed creating '%s.sigmf-data'!\n", path.c_str());
+    std::lock_guard <std::mutex> lock(mutex);
+    snapshotStatus = "failed " + path;
+    writing = false;
+    return;
+  }
+
+  for(unsigned long long seq=start ; !stopping ; )
+  {
+    Record r;
+    bool have = false;
+
+    // Copy one record out, holding the lock only briefly
+    {
+      std::lock_guard <std::mutex> lock(mutex);
+      if(seq < first) { lost += first - seq;seq = first; }
+      if(seq < next)
+      {
+        r = records[seq % records.size()];
+        block.resize(std::max(block.size(), (size_t)r.bytes));
+        memcpy(block.data(), ring + r.offset, r.bytes);
+        have = true;
+        ++seq;
+      }
+    }
+
+    // Wait for more samples, giving up if capture has stopped
+    if(!have)
+    {
+      if(std::chrono::steady_clock::now() - progress > std::chrono::seconds(2)) break;
+      usleep(20000);
+      continue;
+    }
+
+    progress = std::chrono::steady_clock::now();
+
+    // Done once past the end, or at a rate change that SigMF cannot express
+    if((r.timeNs >= endNs) || (rate && (r.rate!=rate))) break;
+
+    const short *data = (const short *)block.data();
+    if(format==FORMAT_LOSSLESS)
+    {
+      samples.resize(std::max(samples.size(), (size_t)(2 * r.samples)));
+      IQCodec::decode(block.data(), r.bytes, samples.data(), r.samples);
+      data = samples.data();
+    }
+
+    // Start a new capture segment on retune or gap in stream time
+    if(!rate || (r.frequency!=frequency) || (llabs(r.timeNs - expectNs) > 1000000000LL / r.rate))
+      captures.push_back({ count, r.frequency, r.wallNs });
+
+    rate      = r.rate;
+    frequency = r.frequency;
+    expectNs  = r.timeNs + (long long)(r.samples * 1000000000.0 / r.rate);
+
+    // Merge active blocks into annotations
+    if(r.active)
+    {
+      if(!active.empty() && (active.back().first + active.back().second == count))
+        active.back().second += r.samples;
+      else
+        active.push_back(std::make_pair(count, (unsigned long long)r.samples));
+    }
+
+    if(fwrite(data, 2 * sizeof(short), r.samples, f)!=r.samples) break;
+    count += r.samples;
+  }
+
+  fclose(f);
+
+  // Describe recording in SigMF metadata
+  f = fopen((path + ".sigmf-meta").c_str(), "wb");
+  if(f)
+  {
+    fprintf(f,
+      "{\n  \"global\": {\n"
+      "    \"core:datatype\": \"ci16_le\",\n"
+      "    \"core:sample_rate\": %u,\n"
+      "    \"core:version\": \"1.0.0\",\n"
+      "    \"core:hw\": \"Malahit-RR\",\n"
+      "    \"core:recorder\": \"SoapyMalahitRR\"\n"
+      "  },\n  \"captures\": [",
+      rate
+    );
+
+    for(unsigned int j=0 ; j<captures.size() ; ++j)
+    {
+      time_t sec = captures[j].wallNs / 1000000000LL;
+      struct tm tm;
+      gmtime_r(&sec, &tm);
+      strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+
+      fprintf(f, "%s\n    { \"core:sample_start\": %llu, \"core:frequency\": %.0f, \"core:datetime\": \"%s.%06lldZ\" }",
+        j? "," : "", captures[j].start, captures[j].frequency, buf, captures[j].wallNs % 1000000000LL / 1000
+      );
+    }
+
+    fprintf(f, "\n  ],\n  \"annotations\": [");
+
+    for(unsigned int j=0 ; j<active.size() ; ++j)
+      fprintf(f, "%s\n    { \"core:sample_start\": %llu, \"core:sample_count\": %llu, \"core:label\": \"activity\" }",
+        j? "," : "", active[j].first, active[j].second
+      );
+
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+  }
+
+  snprintf(buf, sizeof(buf), "done %s: %llu samples, %.1fs, %llu blocks lost",
+    path.c_str(), count, rate? (double)count / rate : 0.0, lost
+  );
+
+  fprintf(stderr, "History::writeSnapshot(): %s\n", buf);
+
+  std::lock_guard <std::mutex> lock(mutex);
+  snapshotStatus = buf;
+  writing = false;
+}
+
+std::string History::getStatus() const
+{
+  double seconds = getSeconds();
+  std::lock_guard <std::mutex> lock(mutex);
+  size_t used = 0;
+  char buf[512];
+
+  for(unsigned long long j=first ; j<next ; ++j) used += records[j % records.size()].bytes;
+
+  snprintf(buf, sizeof(buf), "format=%s\nsize=%zu\nused=%zu\nseconds=%.1f\nsnapshot=%s\n",
+    format==FORMAT_LOSSLESS? "lossless" : "cs16", size, used, seconds,
+    snapshotStatus.empty()? "idle" : snapshotStatus.c_str()
+  );
+
+  return(buf);
+}
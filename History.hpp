@@ -0,0 +1,81 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include "BufferPool.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class History
+{
+  public:
+    enum Format
+    {
+      FORMAT_CS16 = 0,  // Raw samples, cheapest to store
+      FORMAT_LOSSLESS   // IQCodec blocks, about half the memory
+    };
+
+    History() {}
+    ~History() { configure(0); }
+
+    bool configure(size_t bytes, unsigned int format = FORMAT_CS16, unsigned int blockSize = 0, bool hugePages = false);
+      // Keep up to BYTES of most recent samples, arriving in blocks of
+      // about BLOCKSIZE samples. Zero BYTES disables history. Aborts any
+      // snapshot in progress.
+
+    bool isEnabled() const { return(size>0); }
+      // Check if history is being kept.
+
+    void write(const short *data, unsigned int samples, unsigned int rate, long long timeNs, double frequency, bool active);
+      // Add a captured block, evicting the oldest ones as needed.
+
+    bool snapshot(const std::string &path, double postSeconds);
+      // Start writing history, plus POSTSECONDS of samples still to
+      // come, to PATH.sigmf-data and PATH.sigmf-meta in the background.
+
+    bool isWriting() const { return(writing); }
+      // Check if a snapshot is being written.
+
+    double getSeconds() const;
+      // Get duration of history currently held, in seconds.
+
+    std::string getStatus() const;
+      // Print history and snapshot state, one value per line.
+
+    unsigned int getFormat() const { return(format); }
+
+  private:
+    struct Record
+    {
+      size_t offset;                // Position in the ring
+      unsigned int bytes;           // Stored size
+      unsigned int samples;         // Samples in the block
+      unsigned int rate;            // Sample rate
+      long long timeNs;             // Stream time of the first sample
+      long long wallNs;             // Wall clock time of the first sample
+      double frequency;             // Center frequency
+      bool active;                  // Signal activity detected
+    };
+
+    mutable std::mutex mutex;
+    BufferPool pool;
+    unsigned char *ring = 0;
+    size_t size = 0;
+    size_t pos = 0;
+    unsigned int format = FORMAT_CS16;
+    std::vector<Record> records;
+    unsigned long long first = 0;   // Oldest record held
+    unsigned long long next  = 0;   // Record to be written next
+
+    std::thread writer;
+    std::atomic<bool> writing{false};
+    std::atomic<bool> stopping{false};
+    std::string snapshotStatus;
+
+    void writeSnapshot(std::string path, unsigned long long start, long long endNs);
+      // Snapshot thread body.
+};
+
+#endif // HISTORY_HPP
@@ -0,0 +1,220 @@
+#include "IQCodec.hpp"
+#include "Kernels.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+static const unsigned int ESCAPE_BITS = 20;
+  // Raw residual size, enough for any 2nd order residual.
+static const unsigned int UNARY_LIMIT = 24;
+  // Quotients this large are sent raw instead.
+
+class BitWriter
+{
+  public:
+    BitWriter(unsigned char *out): out(out), acc(0), bits(0) {}
+
+    void put(uint64_t value, unsigned int count)
+    {
+      // Up to 56 bits at once, flush whole bytes
+      acc   = (acc << count) | (value & ((1ULL << count) - 1));
+      bits += count;
+      while(bits>=8) { bits -= 8;*out++ = acc >> bits; }
+    }
+
+    void ones(unsigned int count)
+    {
+      for( ; count>=16 ; count-=16) put(0xFFFF, 16);
+      put((1U << count) - 1, count);
+    }
+
+    unsigned char *finish()
+    {
+      if(bits) *out++ = acc << (8 - bits);
+      bits = 0;
+      return(out);
+    }
+
+  private:
+    unsigned char *out;
+    uint64_t acc;
+    unsigned int bits;
+};
+
+class BitReader
+{
+  public:
+    BitReader(const unsigned char *data, const unsigned char *end): data(data), end(end), acc(0), bits(0) {}
+
+    uint32_t get(unsigned int count)
+    {
+      if(!count) return(0);
+      fill(count);
+      bits -= count;
+      return((acc >> bits) & ((1ULL << count) - 1));
+    }
+
+    unsigned int unary(unsigned int limit)
+    {
+      // Count leading ones of pending bits at once
+      fill(limit + 1);
+      unsigned int result = __builtin_clzll(~(acc << (64 - bits)));
+      if(result>=limit) { bits -= limit;return(limit); }
+      bits -= result + 1;
+      return(result);
+    }
+
+    bool overrun() const { return((data>end) && ((size_t)(data - end) * 8 > bits)); }
+      // Check if more bits were consumed than available, lookahead is fine.
+
+  private:
+    const unsigned char *data;
+    const unsigned char *end;
+    uint64_t acc;
+    unsigned int bits;
+
+    void fill(unsigned int count)
+    {
+      // Past the end, feed zeros and let overrun() tell
+      while(bits<count)
+      {
+        acc   = (acc << 8) | (data<end? *data : 0);
+        bits += 8;
+        ++data;
+      }
+    }
+};
+
+static inline int32_t unzigzag(uint32_t x) { return((int32_t)((x >> 1) ^ (0U - (x & 1)))); }
+
+static inline void put32(unsigned char *out, uint32_t value)
+{
+  out[0] = value;
+  out[1] = value >> 8;
+  out[2] = value >> 16;
+  out[3] = value >> 24;
+}
+
+static inline uint32_t get32(const unsigned char *data)
+{
+  return(data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24));
+}
+
+size_t IQCodec::getMaxSize(unsigned int samples)
+{
+  // Every residual escaped, plus run headers for both channels
+  unsigned int runs = (samples + RUN_SIZE - 1) / RUN_SIZE;
+  return(HEADER_SIZE + ((size_t)samples * 2 * (UNARY_LIMIT + ESCAPE_BITS) + runs * 2 * 7) / 8 + 1);
+}
+
+unsigned int IQCodec::getSamples(const unsigned char *data)
+{
+  return(get32(data));
+}
+
+size_t IQCodec::getSize(const unsigned char *data)
+{
+  return(get32(data + 4));
+}
+
+size_t IQCodec::encode(const short *data, unsigned int samples, unsigned char *out)
+{
+  BitWriter bw(out + HEADER_SIZE);
+  const Kernels::Table &kernels = Kernels::get();
+  uint32_t res[3][RUN_SIZE];
+
+  for(unsigned int c=0 ; c<2 ; ++c)
+  {
+    int32_t x1 = 0, x2 = 0;
+
+    for(unsigned int start=0 ; start<samples ; start+=RUN_SIZE)
+    {
+      unsigned int n = samples - start < RUN_SIZE? samples - start : RUN_SIZE;
+      const short *in = data + 2 * start + c;
+      uint64_t sum[3];
+
+      // Residuals of all three predictors
+      kernels.residuals(in, n, x1, x2, res[0], res[1], res[2], sum);
+
+      // Pick predictor with the smallest residuals
+      unsigned int order = 0;
+      if(sum[1] < sum[order]) order = 1;
+      if(sum[2] < sum[order]) order = 2;
+
+      // Rice parameter close to log2 of the mean residual
+      unsigned int k = 0;
+      for(uint64_t mean = sum[order] / n ; ((mean >> k) > 1) && (k<ESCAPE_BITS) ; ++k);
+
+      bw.put(order, 2);
+      bw.put(k, 5);
+
+      for(unsigned int j=0 ; j<n ; ++j)
+      {
+        uint32_t v = res[order][j];
+        uint32_t q = v >> k;
+
+        if(q>=UNARY_LIMIT)
+        {
+          bw.ones(UNARY_LIMIT);
+          bw.put(v, ESCAPE_BITS);
+        }
+        else
+        {
+          // Unary quotient, terminating zero, and remainder in one go
+          bw.put(((((1ULL << q) - 1) << 1) << k) | (v & ((1ULL << k) - 1)), q + 1 + k);
+        }
+      }
+
+      // Carry history into the next run
+      x2 = n>1? in[2 * (n - 2)] : x1;
+      x1 = in[2 * (n - 1)];
+    }
+  }
+
+  size_t size = bw.finish() - out;
+  put32(out, samples);
+  put32(out + 4, size);
+  return(size);
+}
+
+unsigned int IQCodec::decode(const unsigned char *data, size_t size, short *out, unsigned int maxSamples)
+{
+  if(size<HEADER_SIZE) return(0);
+
+  unsigned int samples = getSamples(data);
+  size_t blockSize = getSize(data);
+  if((samples>maxSamples) || (blockSize>size) || (blockSize<HEADER_SIZE)) return(0);
+
+  BitReader br(data + HEADER_SIZE, data + blockSize);
+
+  for(unsigned int c=0 ; c<2 ; ++c)
+  {
+    int32_t x1 = 0, x2 = 0;
+
+    for(unsigned int start=0 ; start<samples ; start+=RUN_SIZE)
+    {
+      unsigned int n = samples - start < RUN_SIZE? samples - start : RUN_SIZE;
+      unsigned int order = br.get(2);
+      unsigned int k = br.get(5);
+      short *dst = out + 2 * start + c;
+
+      if((order>2) || (k>ESCAPE_BITS)) return(0);
+
+      for(unsigned int j=0 ; j<n ; ++j)
+      {
+        uint32_t q = br.unary(UNARY_LIMIT);
+        uint32_t v = q>=UNARY_LIMIT? br.get(ESCAPE_BITS) : (q << k) | br.get(k);
+        int32_t x  = unzigzag(v);
+
+        if(order==1) x += x1;
+        else if(order==2) x += 2 * x1 - x2;
+
+        dst[2 * j] = x;
+        x2 = x1;
+        x1 = x;
+      }
+    }
+  }
+
+  return(br.overrun()? 0 : samples);
+}
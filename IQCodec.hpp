@@ -0,0 +1,41 @@
+#ifndef IQCODEC_HPP
+#define IQCODEC_HPP
+
+#include <stddef.h>
+
+//
+// Lossless CS16 codec. Each channel is split into short runs, each
+// predicted with the best of three fixed polynomial predictors, and
+// the residuals are Rice-coded with a per-run parameter. Blocks start
+// from zero history, so they can be decoded independently.
+//
+// Block layout:
+//   u32 sample count (LE)
+//   u32 encoded size in bytes, including this header (LE)
+//   I runs, then Q runs: 2bit order, 5bit Rice parameter, residuals
+//
+class IQCodec
+{
+  public:
+    static const unsigned int HEADER_SIZE = 8;
+      // Bytes in the block header.
+    static const unsigned int RUN_SIZE = 256;
+      // Samples per prediction run.
+
+    static size_t getMaxSize(unsigned int samples);
+      // Get worst case encoded size of SAMPLES CS16 samples.
+
+    static size_t encode(const short *data, unsigned int samples, unsigned char *out);
+      // Encode CS16 samples into OUT (getMaxSize() bytes), return
+      // encoded size.
+
+    static unsigned int decode(const unsigned char *data, size_t size, short *out, unsigned int maxSamples);
+      // Decode one block into OUT, return number of samples, 0 if the
+      // block is invalid or does not fit.
+
+    static unsigned int getSamples(const unsigned char *data);
+    static size_t getSize(const unsigned char *data);
+      // Get sample count and encoded size from block header.
+};
+
+#endif // IQCODEC_HPP
@@ -0,0 +1,460 @@
+#include "IQServer.hpp"
+#include "Metrics.hpp"
+#include "IQCodec.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/errqueue.h>
+#include <algorithm>
+
+static const char *formatNames[IQServer::FORMAT_COUNT] = { "CU8", "CS16", "CF32", "LOSSLESS" };
+static const unsigned int formatSizes[IQServer::FORMAT_COUNT] = { 2, 4, 8, 0 };
+
+IQServer::IQServer():
+  clientCount(0), running(false), serverSocket(-1), wakeFd(-1),
+  gainCount(0), backlog(DEFAULT_BACKLOG), rt(0)
+{
+}
+
+bool IQServer::start(const char *address, unsigned int gainCount, const Handler &handler, unsigned int backlog, const RealTime *rt)
+{
+  // Stop current server, if any
+  stop();
+
+  if(!strncmp(address, "unix:", 5))
+  {
+    struct sockaddr_un addr;
+    const char *path = address + 5;
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+      fprintf(stderr, "IQServer::start(): Socket name '%s' too long!\n", path);
+      return(false);
+    }
+
+    // Remove stale socket left by a previous run
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    serverSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if((serverSocket>=0) && (bind(serverSocket, (struct sockaddr *)&addr, sizeof(addr))>=0))
+      socketName = path;
+  }
+  else if(!strncmp(address, "tcp:", 4))
+  {
+    struct sockaddr_in addr;
+    const char *port = strrchr(address + 4, ':');
+    std::string host = port? std::string(address + 4, port - address - 4) : "127.0.0.1";
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(atoi(port? port + 1 : address + 4));
+
+    if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr)!=1)
+    {
+      fprintf(stderr, "IQServer::start(): Invalid address '%s'!\n", host.c_str());
+      return(false);
+    }
+
+    serverSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(serverSocket>=0)
+    {
+      setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if(bind(serverSocket, (struct sockaddr *)&addr, sizeof(addr))<0)
+      {
+        ::close(serverSocket);
+        serverSocket = -1;
+      }
+    }
+  }
+  else
+  {
+    fprintf(stderr, "IQServer::start(): Unknown address '%s', expected tcp: or unix:!\n", address);
+    return(false);
+  }
+
+  if((serverSocket<0) || (listen(serverSocket, 4)<0))
+  {
+    fprintf(stderr, "IQServer::start(): Failed listening on '%s'!\n", address);
+    if(serverSocket>=0) ::close(serverSocket);
+    serverSocket = -1;
+    return(false);
+  }
+
+  // This wakes server thread up when new data is published
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(wakeFd<0)
+  {
+    fprintf(stderr, "IQServer::start(): Failed creating eventfd!\n");
+    stop();
+    return(false);
+  }
+
+  fprintf(stderr, "IQServer::start(): Serving IQ data on '%s'.\n", address);
+
+  this->gainCount = gainCount;
+  this->handler   = handler;
+  this->backlog   = backlog;
+  this->rt        = rt;
+
+  running = true;
+  thread  = std::thread(&IQServer::serve, this);
+  return(true);
+}
+
+void IQServer::stop()
+{
+  if(thread.joinable())
+  {
+    running = false;
+    thread.join();
+  }
+
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    for(auto &client: clients) ::close(client->fd);
+    clients.clear();
+    clientCount = 0;
+  }
+
+  if(serverSocket>=0) ::close(serverSocket);
+  if(wakeFd>=0) ::close(wakeFd);
+  if(!socketName.empty()) unlink(socketName.c_str());
+
+  serverSocket = -1;
+  wakeFd = -1;
+  socketName.clear();
+}
+
+void IQServer::publish(const short *data, unsigned int samples)
+{
+  bool used[FORMAT_COUNT] = { false };
+  const unsigned char *buf[FORMAT_COUNT];
+  size_t encoded = 0;
+
+  if(!clientCount || !samples) return;
+
+  std::lock_guard <std::mutex> lock(mutex);
+
+  // Convert data once for each format in use
+  for(auto &client: clients) used[client->format] = true;
+
+  buf[FORMAT_CS16] = (const unsigned char *)data;
+
+  if(used[FORMAT_CU8])
+  {
+    std::vector<unsigned char> &out = converted[FORMAT_CU8];
+    if(out.size() < samples * 2) out.resize(samples * 2);
+    for(unsigned int j=0 ; j<samples*2 ; ++j) out[j] = (data[j] >> 8) + 128;
+    buf[FORMAT_CU8] = out.data();
+  }
+
+  if(used[FORMAT_CF32])
+  {
+    std::vector<unsigned char> &out = converted[FORMAT_CF32];
+    if(out.size() < samples * 8) out.resize(samples * 8);
+    float *dst = (float *)out.data();
+    for(unsigned int j=0 ; j<samples*2 ; ++j) dst[j] = data[j] / 32768.0f;
+    buf[FORMAT_CF32] = out.data();
+  }
+
+  if(used[FORMAT_LOSSLESS])
+  {
+    std::vector<unsigned char> &out = converted[FORMAT_LOSSLESS];
+    if(out.size() < IQCodec::getMaxSize(samples)) out.resize(IQCodec::getMaxSize(samples));
+    encoded = IQCodec::encode(data, samples, out.data());
+    buf[FORMAT_LOSSLESS] = out.data();
+  }
+
+  // Queue data to each client, dropping whole blocks if out of room
+  for(auto &client: clients)
+  {
+    size_t bytes = client->format==FORMAT_LOSSLESS? encoded : samples * formatSizes[client->format];
+    size_t size  = client->ring.size();
+
+    if(size - (client->head - client->freed) < bytes)
+    {
+      client->dropped += bytes;
+      client->drops++;
+      continue;
+    }
+
+    size_t offset = client->head % size;
+    size_t first  = std::min(bytes, size - offset);
+    memcpy(client->ring.data() + offset, buf[client->format], first);
+    memcpy(client->ring.data(), buf[client->format] + first, bytes - first);
+    client->head += bytes;
+  }
+
+  uint64_t one = 1;
+  if(::write(wakeFd, &one, sizeof(one))<0) { /* Already signaled */ }
+}
+
+std::string IQServer::getStats() const
+{
+  std::lock_guard <std::mutex> lock(mutex);
+  unsigned long long now = Metrics::now();
+  std::string result;
+  char buf[512];
+
+  for(auto &client: clients)
+  {
+    double seconds = (now - client->connected) / 1000000.0;
+
+    snprintf(buf, sizeof(buf),
+      "peer=%s format=%s zerocopy=%s sent=%llu queued=%llu dropped=%llu drops=%llu rate=%.1fkB/s\n",
+      client->peer.c_str(), formatNames[client->format], client->zeroCopy? "true":"false",
+      client->sent, client->head - client->sent, client->dropped, client->drops,
+      seconds>0.0? client->sent / seconds / 1000.0 : 0.0
+    );
+    result += buf;
+  }
+
+  return(result);
+}
+
+void IQServer::serve()
+{
+  std::vector<struct pollfd> pfds;
+  uint64_t value;
+
+  if(rt) rt->apply();
+
+  while(running)
+  {
+    // Poll server socket, wakeup event, and all clients
+    pfds.resize(2);
+    pfds[0].fd     = serverSocket;
+    pfds[0].events = POLLIN;
+    pfds[1].fd     = wakeFd;
+    pfds[1].events = POLLIN;
+
+    {
+      std::lock_guard <std::mutex> lock(mutex);
+      for(auto &client: clients)
+      {
+        struct pollfd pfd;
+        pfd.fd      = client->fd;
+        pfd.events  = POLLIN | (client->head>client->sent? POLLOUT : 0);
+        pfd.revents = 0;
+        pfds.push_back(pfd);
+      }
+    }
+
+    // Check for stop request every 100ms
+    if(poll(pfds.data(), pfds.size(), 100) <= 0) continue;
+
+    if(pfds[1].revents & POLLIN)
+      if(::read(wakeFd, &value, sizeof(value))<0) { /* Not signaled */ }
+
+    // Only this thread changes the list, safe to walk it unlocked
+    bool closed = false;
+    for(size_t j=2 ; j<pfds.size() ; ++j)
+    {
+      Client &client = *clients[j-2];
+
+      if((pfds[j].revents & POLLERR) && client.zeroCopy) complete(client);
+
+      bool ok = true;
+      if(pfds[j].revents & (POLLIN|POLLHUP|POLLERR)) ok = receive(client);
+      if(ok) ok = send(client);
+
+      if(!ok)
+      {
+        fprintf(stderr, "IQServer::serve(): Client %s disconnected.\n", client.peer.c_str());
+        ::close(client.fd);
+        client.fd = -1;
+        closed = true;
+      }
+    }
+
+    if(closed)
+    {
+      std::lock_guard <std::mutex> lock(mutex);
+      clients.erase(std::remove_if(clients.begin(), clients.end(),
+        [](const std::unique_ptr<Client> &client) { return(client->fd<0); }), clients.end());
+      clientCount = clients.size();
+    }
+
+    if(pfds[0].revents & POLLIN) accept();
+  }
+}
+
+void IQServer::accept()
+{
+  struct sockaddr_storage addr;
+  socklen_t addrLength = sizeof(addr);
+  unsigned char header[12] = { 'R', 'T', 'L', '0' };
+  char peer[INET6_ADDRSTRLEN + 8] = "local";
+  int one = 1;
+
+  int fd = accept4(serverSocket, (struct sockaddr *)&addr, &addrLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if(fd<0) return;
+
+  std::unique_ptr<Client> client(new Client());
+  client->fd        = fd;
+  client->format    = FORMAT_CU8;
+  client->zeroCopy  = false;
+  client->connected = Metrics::now();
+
+  if(addr.ss_family==AF_INET)
+  {
+    struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+    inet_ntop(AF_INET, &in->sin_addr, peer, sizeof(peer));
+    snprintf(peer + strlen(peer), 8, ":%u", ntohs(in->sin_port));
+
+    // Send small blocks right away, avoid copying large ones
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    client->zeroCopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))==0;
+#endif
+  }
+
+  client->peer = peer;
+  client->ring.resize(backlog);
+
+  // Send rtl_tcp header: magic, tuner type (unknown), gain count
+  header[8]  = gainCount >> 24;
+  header[9]  = gainCount >> 16;
+  header[10] = gainCount >> 8;
+  header[11] = gainCount;
+
+  if(::send(fd, header, sizeof(header), MSG_NOSIGNAL)!=sizeof(header))
+  {
+    fprintf(stderr, "IQServer::accept(): Failed sending header to %s!\n", peer);
+    ::close(fd);
+    return;
+  }
+
+  fprintf(stderr, "IQServer::accept(): Client %s connected%s.\n", peer, client->zeroCopy? " (zero-copy)" : "");
+
+  std::lock_guard <std::mutex> lock(mutex);
+  clients.push_back(std::move(client));
+  clientCount = clients.size();
+}
+
+bool IQServer::receive(Client &client)
+{
+  for(;;)
+  {
+    ssize_t res = recv(client.fd, client.cmd + client.cmdLength, sizeof(client.cmd) - client.cmdLength, MSG_DONTWAIT);
+    if(res==0) return(false);
+    if(res<0) return((errno==EAGAIN) || (errno==EWOULDBLOCK) || (errno==EINTR));
+
+    // Commands are a byte followed by a big-endian parameter
+    client.cmdLength += res;
+    if(client.cmdLength < sizeof(client.cmd)) continue;
+    client.cmdLength = 0;
+
+    unsigned int command = client.cmd[0];
+    unsigned int param   =
+      (client.cmd[1] << 24) | (client.cmd[2] << 16) | (client.cmd[3] << 8) | client.cmd[4];
+
+    if(command==CMD_FORMAT)
+    {
+      // Data already queued stays in the old format
+      std::lock_guard <std::mutex> lock(mutex);
+      if(param<FORMAT_COUNT) client.format = param;
+    }
+    else if(handler)
+    {
+      handler(command, param);
+    }
+  }
+}
+
+bool IQServer::send(Client &client)
+{
+  struct iovec iov[2];
+  struct msghdr msg;
+  unsigned long long head;
+  int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    head = client.head;
+  }
+
+  // Nothing to send, or too many zero-copy sends in flight
+  if(head==client.sent) return(true);
+  if(client.zeroCopy && (client.zcNext - client.zcDone >= ZC_PENDING)) return(true);
+
+  // Queued data may wrap around the ring end
+  size_t size   = client.ring.size();
+  size_t offset = client.sent % size;
+  size_t length = head - client.sent;
+
+  iov[0].iov_base = client.ring.data() + offset;
+  iov[0].iov_len  = std::min(length, size - offset);
+  iov[1].iov_base = client.ring.data();
+  iov[1].iov_len  = length - iov[0].iov_len;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = iov[1].iov_len? 2 : 1;
+
+#ifdef MSG_ZEROCOPY
+  if(client.zeroCopy) flags |= MSG_ZEROCOPY;
+#endif
+
+  // Sent data is not touched by publish(), no need to lock here
+  ssize_t res = sendmsg(client.fd, &msg, flags);
+  if(res<0) return((errno==EAGAIN) || (errno==EWOULDBLOCK) || (errno==EINTR) || (errno==ENOBUFS));
+
+  std::lock_guard <std::mutex> lock(mutex);
+  client.sent += res;
+
+  // Zero-copy data stays in use until the kernel reports completion
+  if(client.zeroCopy)
+    client.zcEnd[client.zcNext++ % ZC_PENDING] = client.sent;
+  else
+    client.freed = client.sent;
+
+  return(true);
+}
+
+void IQServer::complete(Client &client)
+{
+  char control[128];
+  struct msghdr msg;
+
+  for(;;)
+  {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    if(recvmsg(client.fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT)<0) break;
+
+    for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg) ; cm ; cm = CMSG_NXTHDR(&msg, cm))
+    {
+      if(!((cm->cmsg_level==SOL_IP) && (cm->cmsg_type==IP_RECVERR))
+      && !((cm->cmsg_level==SOL_IPV6) && (cm->cmsg_type==IPV6_RECVERR))) continue;
+
+      struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+      if(err->ee_errno || (err->ee_origin!=SO_EE_ORIGIN_ZEROCOPY)) continue;
+
+      // Sends ee_info..ee_data completed, TCP completes them in order
+      unsigned int done = err->ee_data + 1;
+      std::lock_guard <std::mutex> lock(mutex);
+      if(done - client.zcDone <= client.zcNext - client.zcDone)
+      {
+        client.zcDone = done;
+        client.freed  = client.zcEnd[(done - 1) % ZC_PENDING];
+      }
+    }
+  }
+}
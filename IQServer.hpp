@@ -0,0 +1,121 @@
+#ifndef IQSERVER_HPP
+#define IQSERVER_HPP
+
+#include "RealTime.hpp"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class IQServer
+{
+  public:
+    enum Format
+    {
+      FORMAT_CU8 = 0,   // Offset binary 8bit, as sent by rtl_tcp
+      FORMAT_CS16,      // Native signed 16bit
+      FORMAT_CF32,      // Float, full scale is 1.0
+      FORMAT_LOSSLESS,  // CS16 compressed into IQCodec blocks
+      FORMAT_COUNT
+    };
+
+    enum Command
+    {
+      CMD_FREQUENCY       = 0x01, // Center frequency, Hz
+      CMD_SAMPLE_RATE     = 0x02, // Sample rate, Hz
+      CMD_GAIN_MODE       = 0x03, // 0: automatic, 1: manual
+      CMD_GAIN            = 0x04, // Gain, tenths of dB
+      CMD_FREQ_CORRECTION = 0x05, // Frequency correction, ppm
+      CMD_AGC_MODE        = 0x08, // 0: off, 1: on
+      CMD_GAIN_INDEX      = 0x0D, // Gain, index into gain table
+      CMD_FORMAT          = 0x80  // Extension: sample format (Format)
+    };
+
+    static const unsigned int DEFAULT_BACKLOG = 1024 * 1024;
+      // Default per-client backlog, in bytes.
+
+    typedef std::function<void(unsigned int command, unsigned int param)> Handler;
+      // Called from the server thread to apply client commands.
+
+    IQServer();
+    ~IQServer() { stop(); }
+
+    bool start(const char *address, unsigned int gainCount, const Handler &handler, unsigned int backlog = DEFAULT_BACKLOG, const RealTime *rt = 0);
+      // Start serving on "tcp:port", "tcp:host:port" or "unix:path".
+      // Port-only addresses listen on loopback.
+
+    void stop();
+      // Disconnect all clients and stop serving.
+
+    bool isRunning() const { return(running); }
+      // Check if server is running.
+
+    unsigned int getClientCount() const { return(clientCount); }
+      // Get number of connected clients.
+
+    void publish(const short *data, unsigned int samples);
+      // Queue given CS16 samples to all clients, converting them to
+      // each client's format. Clients without room drop the block.
+
+    std::string getStats() const;
+      // Print per-client throughput and drops, one client per line.
+
+  private:
+    static const unsigned int ZC_PENDING = 64;
+      // Maximum zero-copy sends awaiting completion, per client.
+
+    struct Client
+    {
+      int fd;
+      std::string peer;
+      unsigned int format;
+      std::vector<unsigned char> ring;
+      unsigned long long head;    // Bytes queued
+      unsigned long long sent;    // Bytes handed to the kernel
+      unsigned long long freed;   // Bytes kernel is done with
+      bool zeroCopy;
+      unsigned int zcNext;        // Next zero-copy send ID
+      unsigned int zcDone;        // Next zero-copy ID to complete
+      unsigned long long zcEnd[ZC_PENDING];
+      unsigned char cmd[5];
+      unsigned int cmdLength;
+      unsigned long long dropped;
+      unsigned long long drops;
+      unsigned long long connected;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<Client>> clients;
+    std::atomic<unsigned int> clientCount;
+    std::vector<unsigned char> converted[FORMAT_COUNT];
+
+    std::thread thread;
+    std::atomic<bool> running;
+    int serverSocket;
+    int wakeFd;
+    std::string socketName;
+    unsigned int gainCount;
+    unsigned int backlog;
+    Handler handler;
+    const RealTime *rt;
+
+    void serve();
+      // Accept clients, execute their commands and send out data.
+
+    void accept();
+      // Accept a new client.
+
+    bool receive(Client &client);
+      // Receive and execute client commands.
+
+    bool send(Client &client);
+      // Send out queued data.
+
+    void complete(Client &client);
+      // Release data sent with zero-copy once the kernel is done with it.
+};
+
+#endif // IQSERVER_HPP
@@ -0,0 +1,431 @@
+#include "Kernels.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#if defined(__arm__) || defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+//
+// Kernel bodies are written once as plain loops the compiler can
+// vectorize, then compiled for each instruction set with function
+// target attributes, so that one binary carries all of them. GCC only
+// vectorizes very cheap loops at -O2, as Debian builds, and leaves the
+// stats lanes rolled, so variants are optimized as at -O3 regardless.
+//
+#define KERNEL_BODY static inline __attribute__((always_inline))
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define VECTORIZE     optimize("O3")
+#define SCALAR_TARGET __attribute__((optimize("no-tree-vectorize")))
+#else
+#define VECTORIZE
+#define SCALAR_TARGET
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#define SSE41_TARGET __attribute__((target("sse4.1"), VECTORIZE))
+#define AVX2_TARGET  __attribute__((target("avx2"), VECTORIZE))
+#endif
+
+#if defined(__aarch64__)
+#define KERNELS_NEON
+#define NEON_TARGET  __attribute__((VECTORIZE))
+#elif defined(__arm__) && !defined(__SOFTFP__) && !defined(__clang__)
+#define KERNELS_NEON
+#define NEON_TARGET  __attribute__((target("fpu=neon"), VECTORIZE))
+#endif
+
+KERNEL_BODY void statsBody(const short *data, unsigned int samples, int clipLevel, float *sum, int *peak, int *clip)
+{
+  const unsigned int LANES = Kernels::LANES;
+  float s[LANES];
+  int p[LANES], c[LANES];
+  unsigned int j;
+
+  // Local copies keep lanes in registers
+  for(unsigned int k=0 ; k<LANES ; ++k) { s[k] = sum[k];p[k] = peak[k];c[k] = clip[k]; }
+
+  for(j=0 ; j+LANES<=2*samples ; j+=LANES)
+    for(unsigned int k=0 ; k<LANES ; ++k)
+    {
+      int x = data[j + k];
+      int a = x<0? -x : x;
+      s[k] += (float)(x * x);
+      p[k] = std::max(p[k], a);
+      c[k] += a >= clipLevel;
+    }
+
+  // Remaining samples
+  for(unsigned int k=0 ; j<2*samples ; ++j, ++k)
+  {
+    int x = data[j];
+    int a = x<0? -x : x;
+    s[k] += (float)(x * x);
+    p[k] = std::max(p[k], a);
+    c[k] += a >= clipLevel;
+  }
+
+  for(unsigned int k=0 ; k<LANES ; ++k) { sum[k] = s[k];peak[k] = p[k];clip[k] = c[k]; }
+}
+
+KERNEL_BODY void envelopeBody(const short *data, unsigned int samples, int *mag)
+{
+  // Stepping pointers, as unsigned 2*K indices may wrap and defeat
+  // the vectorizer
+  for(const short *end = data + 2 * samples ; data<end ; data+=2)
+  {
+    int i = data[0], q = data[1];
+    *mag++ = (i<0? -i : i) + (q<0? -q : q);
+  }
+}
+
+KERNEL_BODY void toFloatBody(const short *in, float *out, unsigned int count)
+{
+  for(unsigned int k=0 ; k<count ; ++k) out[k] = in[k] * (1.0f / 32768.0f);
+}
+
+KERNEL_BODY void toShortBody(const float *in, short *out, unsigned int count)
+{
+  for(unsigned int k=0 ; k<count ; ++k)
+  {
+    float v = in[k] * 32768.0f;
+    v = v>=32767.0f? 32767.0f : v;
+    v = v<=-32768.0f? -32768.0f : v;
+    out[k] = (short)v;
+  }
+}
+
+static inline uint32_t zigzag(int32_t x) { return(((uint32_t)x << 1) ^ (uint32_t)(x >> 31)); }
+
+KERNEL_BODY void residualsBody(const short *data, unsigned int samples, int32_t x1, int32_t x2, uint32_t *res0, uint32_t *res1, uint32_t *res2, uint64_t *sum)
+{
+  uint64_t s0 = 0, s1 = 0, s2 = 0;
+  size_t j;
+
+  // First two samples predict from history
+  for(j=0 ; (j<samples) && (j<2) ; ++j)
+  {
+    int32_t x  = data[2 * j];
+    int32_t p1 = j? data[0] : x1;
+    int32_t p2 = j? x1 : x2;
+    s0 += res0[j] = zigzag(x);
+    s1 += res1[j] = zigzag(x - p1);
+    s2 += res2[j] = zigzag(x - 2 * p1 + p2);
+  }
+
+  // The rest only looks back into DATA. Indices are size_t throughout,
+  // as unsigned 2*J may wrap and defeat the vectorizer.
+  for( ; j<samples ; ++j)
+  {
+    int32_t x  = data[2 * j];
+    int32_t p1 = data[2 * j - 2];
+    int32_t p2 = data[2 * j - 4];
+    s0 += res0[j] = zigzag(x);
+    s1 += res1[j] = zigzag(x - p1);
+    s2 += res2[j] = zigzag(x - 2 * p1 + p2);
+  }
+
+  sum[0] = s0;
+  sum[1] = s1;
+  sum[2] = s2;
+}
+
+KERNEL_BODY void averageBody(const short *data, unsigned int outputs, unsigned int factor, float *out)
+{
+  // Integer sums are exact, so all variants agree
+  float scale = 1.0f / (factor * 32768.0f);
+
+  // Inner sums vectorize, outputs are too few to bother
+  for(size_t j=0 ; j<outputs ; ++j, data+=2*factor)
+  {
+    int i = 0, q = 0;
+    for(size_t k=0 ; k<factor ; ++k) { i += data[2 * k];q += data[2 * k + 1]; }
+    out[2 * j]     = i * scale;
+    out[2 * j + 1] = q * scale;
+  }
+}
+
+KERNEL_BODY void powerBody(const float *data, unsigned int count, float *power)
+{
+  for(size_t k=0 ; k<count ; ++k)
+    power[k] += data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1];
+}
+
+#define DEFINE_KERNELS(NAME, TARGET) \
+  TARGET static void NAME##Stats(const short *data, unsigned int samples, int clipLevel, float *sum, int *peak, int *clip) \
+  { statsBody(data, samples, clipLevel, sum, peak, clip); } \
+  TARGET static void NAME##Envelope(const short *data, unsigned int samples, int *mag) \
+  { envelopeBody(data, samples, mag); } \
+  TARGET static void NAME##ToFloat(const short *in, float *out, unsigned int count) \
+  { toFloatBody(in, out, count); } \
+  TARGET static void NAME##ToShort(const float *in, short *out, unsigned int count) \
+  { toShortBody(in, out, count); } \
+  TARGET static void NAME##Residuals(const short *data, unsigned int samples, int32_t x1, int32_t x2, uint32_t *res0, uint32_t *res1, uint32_t *res2, uint64_t *sum) \
+  { residualsBody(data, samples, x1, x2, res0, res1, res2, sum); } \
+  TARGET static void NAME##Average(const short *data, unsigned int outputs, unsigned int factor, float *out) \
+  { averageBody(data, outputs, factor, out); } \
+  TARGET static void NAME##Power(const float *data, unsigned int count, float *power) \
+  { powerBody(data, count, power); } \
+  static const Kernels::Table NAME##Table = \
+  { NAME##Stats, NAME##Envelope, NAME##ToFloat, NAME##ToShort, NAME##Residuals, NAME##Average, NAME##Power };
+
+DEFINE_KERNELS(scalar, SCALAR_TARGET)
+#ifdef KERNELS_NEON
+DEFINE_KERNELS(neon, NEON_TARGET)
+#endif
+#ifdef KERNELS_X86
+DEFINE_KERNELS(sse41, SSE41_TARGET)
+DEFINE_KERNELS(avx2, AVX2_TARGET)
+#endif
+
+static const Kernels::Table *tables[Kernels::VARIANT_COUNT] =
+{
+  &scalarTable,
+#ifdef KERNELS_NEON
+  &neonTable,
+#else
+  0,
+#endif
+#ifdef KERNELS_X86
+  &sse41Table,
+  &avx2Table
+#else
+  0,
+  0
+#endif
+};
+
+static const char *variantNames[Kernels::VARIANT_COUNT] = { "scalar", "neon", "sse4.1", "avx2" };
+
+std::atomic<const Kernels::Table *> Kernels::active{&scalarTable};
+
+struct TestResult
+{
+  bool passed = false;
+  double ns[7] = { 0.0 };             // Time per sample for each kernel
+};
+
+static std::mutex testMutex;
+static bool tested = false;
+static bool testPassed = false;
+static TestResult testResults[Kernels::VARIANT_COUNT];
+  // Self-test state, protected by testMutex.
+
+static inline unsigned long long nowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+bool Kernels::isSupported(unsigned int variant)
+{
+  if((variant>=VARIANT_COUNT) || !tables[variant]) return(false);
+
+  switch(variant)
+  {
+#ifdef KERNELS_X86
+    case VARIANT_SSE41:
+      __builtin_cpu_init();
+      return(__builtin_cpu_supports("sse4.1"));
+    case VARIANT_AVX2:
+      __builtin_cpu_init();
+      return(__builtin_cpu_supports("avx2"));
+#endif
+#if defined(__arm__) && defined(KERNELS_NEON)
+    case VARIANT_NEON:
+      // HWCAP_NEON, not all ARMv7 boards have it
+      return(!!(getauxval(AT_HWCAP) & (1 << 12)));
+#endif
+    default:
+      // Scalar always works, NEON is baseline on AArch64
+      return(true);
+  }
+}
+
+bool Kernels::selfTest()
+{
+  const unsigned int samples = 16384;
+  const unsigned int runs = 16;
+  const unsigned int factor = 5;
+  const unsigned int timedFactor = 16;
+
+  std::lock_guard <std::mutex> lock(testMutex);
+  if(tested) return(testPassed);
+
+  // Random samples at all levels, with full scale ones to hit clipping
+  std::vector<short> data(2 * samples);
+  std::vector<float> floats(2 * samples);
+  unsigned int seed = 1;
+
+  for(unsigned int j=0 ; j<2*samples ; ++j)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    data[j]   = j % 97? (short)(seed & 0xFFFF) >> (seed >> 28) : j & 1? 32767 : -32768;
+    floats[j] = (int)(seed % 98304) / 32768.0f - 1.5f;
+  }
+
+  // Odd length, so that remainder loops run too
+  const unsigned int n = samples - 3;
+  float refSum[LANES] = { 0.0f };
+  int refPeak[LANES] = { 0 }, refClip[LANES] = { 0 };
+  std::vector<int> refMag(samples);
+  std::vector<float> refFloat(2 * samples);
+  std::vector<short> refShort(2 * samples);
+  std::vector<uint32_t> refRes(3 * samples);
+  uint64_t refResSum[3];
+  std::vector<float> refAverage(2 * samples);
+  std::vector<float> refPower(samples, 0.0f);
+
+  scalarTable.stats(data.data(), n, 32767, refSum, refPeak, refClip);
+  scalarTable.envelope(data.data(), n, refMag.data());
+  scalarTable.toFloat(data.data(), refFloat.data(), 2 * n);
+  scalarTable.toShort(floats.data(), refShort.data(), 2 * n);
+  scalarTable.residuals(data.data(), n, 1234, -5678, &refRes[0], &refRes[samples], &refRes[2 * samples], refResSum);
+  scalarTable.average(data.data(), n / factor, factor, refAverage.data());
+  scalarTable.power(floats.data(), n, refPower.data());
+
+  testPassed = true;
+
+  for(unsigned int v=0 ; v<VARIANT_COUNT ; ++v)
+  {
+    if(!isSupported(v)) continue;
+
+    const Table &t = *tables[v];
+    float sum[LANES] = { 0.0f };
+    int peak[LANES] = { 0 }, clip[LANES] = { 0 };
+    std::vector<int> mag(samples);
+    std::vector<float> outFloat(2 * samples);
+    std::vector<short> outShort(2 * samples);
+    std::vector<uint32_t> res(3 * samples);
+    uint64_t resSum[3];
+    std::vector<float> average(2 * samples);
+    std::vector<float> power(samples, 0.0f);
+    bool passed = true;
+
+    t.stats(data.data(), n, 32767, sum, peak, clip);
+    t.envelope(data.data(), n, mag.data());
+    t.toFloat(data.data(), outFloat.data(), 2 * n);
+    t.toShort(floats.data(), outShort.data(), 2 * n);
+    t.residuals(data.data(), n, 1234, -5678, &res[0], &res[samples], &res[2 * samples], resSum);
+    t.average(data.data(), n / factor, factor, average.data());
+    t.power(floats.data(), n, power.data());
+
+    // Sums may be added in another order, everything else must match
+    for(unsigned int k=0 ; k<LANES ; ++k)
+      passed &= (fabs(sum[k] - refSum[k]) <= 1e-5 * refSum[k]) && (peak[k]==refPeak[k]) && (clip[k]==refClip[k]);
+    passed &= !memcmp(mag.data(), refMag.data(), n * sizeof(int));
+    passed &= !memcmp(outFloat.data(), refFloat.data(), 2 * n * sizeof(float));
+    passed &= !memcmp(outShort.data(), refShort.data(), 2 * n * sizeof(short));
+    passed &= !memcmp(res.data(), refRes.data(), res.size() * sizeof(uint32_t)) && !memcmp(resSum, refResSum, sizeof(resSum));
+    passed &= !memcmp(average.data(), refAverage.data(), 2 * (n / factor) * sizeof(float));
+    for(unsigned int k=0 ; k<n ; ++k)
+      passed &= fabs(power[k] - refPower[k]) <= 1e-5 * refPower[k];
+
+    if(!passed)
+      fprintf(stderr, "Kernels::selfTest(): Variant '%s' does not match scalar code!\n", variantNames[v]);
+
+    // Time each kernel over the whole buffer
+    unsigned long long t0 = nowNs(), t1;
+    for(unsigned int j=0 ; j<runs ; ++j) t.stats(data.data(), samples, 32767, sum, peak, clip);
+    t1 = nowNs();
+    testResults[v].ns[0] = (double)(t1 - t0) / runs / samples;
+    for(unsigned int j=0 ; j<runs ; ++j) t.envelope(data.data(), samples, mag.data());
+    t0 = nowNs();
+    testResults[v].ns[1] = (double)(t0 - t1) / runs / samples;
+    for(unsigned int j=0 ; j<runs ; ++j) t.toFloat(data.data(), outFloat.data(), 2 * samples);
+    t1 = nowNs();
+    testResults[v].ns[2] = (double)(t1 - t0) / runs / samples;
+    for(unsigned int j=0 ; j<runs ; ++j) t.toShort(floats.data(), outShort.data(), 2 * samples);
+    t0 = nowNs();
+    testResults[v].ns[3] = (double)(t0 - t1) / runs / samples;
+    for(unsigned int j=0 ; j<runs ; ++j) t.residuals(data.data(), samples, 0, 0, &res[0], &res[samples], &res[2 * samples], resSum);
+    t1 = nowNs();
+    testResults[v].ns[4] = (double)(t1 - t0) / runs / samples;
+    for(unsigned int j=0 ; j<runs ; ++j) t.average(data.data(), samples / timedFactor, timedFactor, average.data());
+    t0 = nowNs();
+    testResults[v].ns[5] = (double)(t0 - t1) / runs / samples;
+    for(unsigned int j=0 ; j<runs ; ++j) t.power(floats.data(), samples, power.data());
+    t1 = nowNs();
+    testResults[v].ns[6] = (double)(t1 - t0) / runs / samples;
+
+    testResults[v].passed = passed;
+    testPassed &= passed;
+  }
+
+  tested = true;
+  return(testPassed);
+}
+
+bool Kernels::select(const std::string &name)
+{
+  selfTest();
+
+  // Pick the best variant that works
+  if(name.empty() || (name=="auto"))
+  {
+    for(unsigned int v=VARIANT_COUNT ; v-- > 0 ; )
+      if(isSupported(v) && testResults[v].passed)
+      {
+        active = tables[v];
+        return(true);
+      }
+
+    return(false);
+  }
+
+  for(unsigned int v=0 ; v<VARIANT_COUNT ; ++v)
+    if(name==variantNames[v])
+    {
+      if(!isSupported(v) || !testResults[v].passed)
+      {
+        fprintf(stderr, "Kernels::select(): Variant '%s' is not usable on this CPU!\n", name.c_str());
+        return(false);
+      }
+
+      active = tables[v];
+      return(true);
+    }
+
+  fprintf(stderr, "Kernels::select(): Unknown variant '%s'!\n", name.c_str());
+  return(false);
+}
+
+std::string Kernels::getStatus()
+{
+  std::string result = "supported=";
+  char buf[256];
+
+  selfTest();
+
+  for(unsigned int v=0, n=0 ; v<VARIANT_COUNT ; ++v)
+    if(isSupported(v)) result += std::string(n++? "," : "") + variantNames[v];
+  result += "\n";
+
+  for(unsigned int v=0 ; v<VARIANT_COUNT ; ++v)
+    if(active.load()==tables[v]) result += std::string("selected=") + variantNames[v] + "\n";
+
+  // Self-test results, with time per sample of each kernel
+  for(unsigned int v=0 ; v<VARIANT_COUNT ; ++v)
+    if(isSupported(v))
+    {
+      const TestResult &r = testResults[v];
+      snprintf(buf, sizeof(buf), "%s: %s, stats %.2fns, envelope %.2fns, toFloat %.2fns, toShort %.2fns,"
+        " residuals %.2fns, average %.2fns, power %.2fns\n",
+        variantNames[v], r.passed? "OK" : "FAILED", r.ns[0], r.ns[1], r.ns[2], r.ns[3], r.ns[4], r.ns[5], r.ns[6]
+      );
+      result += buf;
+    }
+
+  return(result);
+}
@@ -0,0 +1,68 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+class Kernels
+{
+  public:
+    enum Variant
+    {
+      VARIANT_SCALAR = 0,  // Reference code, never vectorized
+      VARIANT_NEON,        // ARM Advanced SIMD
+      VARIANT_SSE41,       // x86 SSE4.1
+      VARIANT_AVX2,        // x86 AVX2
+      VARIANT_COUNT
+    };
+
+    struct Table
+    {
+      void (*stats)(const short *data, unsigned int samples, int clipLevel, float *sum, int *peak, int *clip);
+        // Accumulate squares, peak magnitudes and clipped counts of CS16
+        // samples in LANES lanes, even lanes being I and odd ones Q.
+      void (*envelope)(const short *data, unsigned int samples, int *mag);
+        // Compute |I|+|Q| of CS16 samples.
+      void (*toFloat)(const short *in, float *out, unsigned int count);
+        // Convert COUNT shorts to floats scaled to [-1, 1).
+      void (*toShort)(const float *in, short *out, unsigned int count);
+        // Convert COUNT floats to shorts, clipping at full scale.
+      void (*residuals)(const short *data, unsigned int samples, int32_t x1, int32_t x2, uint32_t *res0, uint32_t *res1, uint32_t *res2, uint64_t *sum);
+        // Compute zigzagged residuals of 0th, 1st and 2nd order predictors
+        // over one channel of CS16 samples, preceded by X1 and X2, and
+        // their sums in SUM[0..2].
+      void (*average)(const short *data, unsigned int outputs, unsigned int factor, float *out);
+        // Average each FACTOR CS16 samples into a complex float scaled
+        // to [-1, 1).
+      void (*power)(const float *data, unsigned int count, float *power);
+        // Add squared magnitudes of COUNT complex floats to POWER.
+    };
+
+    static const unsigned int LANES = 16;
+      // Lanes used by the stats kernel.
+
+    static const Table &get() { return(*active.load(std::memory_order_relaxed)); }
+      // Get kernels currently in use.
+
+    static bool select(const std::string &name);
+      // Use kernels by variant name: scalar, neon, sse4.1, avx2, or auto
+      // for the best one supported. Variants the CPU lacks, or that fail
+      // the self-test, are refused.
+
+    static bool isSupported(unsigned int variant);
+      // Check if the CPU and this build support given variant.
+
+    static bool selfTest();
+      // Check every supported variant against scalar code and time it.
+      // Runs once, later calls return the first result.
+
+    static std::string getStatus();
+      // Print supported variants, self-test results and current
+      // selection, one per line.
+
+  private:
+    static std::atomic<const Table *> active;
+};
+
+#endif // KERNELS_HPP
@@ -0,0 +1,268 @@
+#include "MalahitClient.hpp"
+#include "IQServer.hpp"
+
+#include <stdio.h>
+#include <stdexcept>
+
+MalahitClient::MalahitClient(const SoapySDR::Kwargs &args)
+{
+  shmName = args.at("shm");
+
+  if(!ring.attach(shmName.c_str()))
+    throw std::runtime_error("MalahitClient: cannot attach to '" + shmName + "'");
+
+  if(!ring.isAlive())
+    fprintf(stderr, "MalahitClient(): Ring '%s' owner does not seem to be running.\n", shmName.c_str());
+}
+
+void MalahitClient::request(unsigned int command, unsigned int param)
+{
+  if(!ring.request(command, param))
+    throw std::runtime_error("MalahitClient: request rejected by '" + shmName + "' owner");
+}
+
+/*******************************************************************
+ * Identification API
+ ******************************************************************/
+
+std::string MalahitClient::getDriverKey(void) const
+{
+  return("Malahit");
+}
+
+std::string MalahitClient::getHardwareKey(void) const
+{
+  return("R1");
+}
+
+SoapySDR::Kwargs MalahitClient::getHardwareInfo(void) const
+{
+  SoapySDR::Kwargs result;
+
+  result["shm"] = shmName;
+
+  return(result);
+}
+
+/*******************************************************************
+ * Channels API
+ ******************************************************************/
+
+size_t MalahitClient::getNumChannels(const int direction) const
+{
+  return(direction==SOAPY_SDR_RX? 1 : 0);
+}
+
+/*******************************************************************
+ * Stream API
+ ******************************************************************/
+
+std::vector<std::string> MalahitClient::getStreamFormats(const int direction, const size_t channel) const
+{
+  std::vector<std::string> result;
+
+  result.push_back("CS16");
+
+  return(result);
+}
+
+std::string MalahitClient::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
+{
+  fullScale = 32768;
+  return("CS16");
+}
+
+SoapySDR::Stream *MalahitClient::setupStream(const int direction, const std::string &format, const std::vector<size_t> &channels, const SoapySDR::Kwargs &args)
+{
+  // We only have one RX channel
+  if((direction!=SOAPY_SDR_RX) || (channels.size()>1) || ((channels.size()>0) && (channels.at(0)>0)))
+    throw std::runtime_error("setupStream invalid channel selection");
+
+  // We only support CS16 data format
+  if(format!="CS16")
+    throw std::runtime_error("setupStream invalid format '" + format + "'");
+
+  return(reinterpret_cast<SoapySDR::Stream *>(&ring));
+}
+
+void MalahitClient::closeStream(SoapySDR::Stream *stream)
+{
+  active = false;
+}
+
+size_t MalahitClient::getStreamMTU(SoapySDR::Stream *stream) const
+{
+  return(4096);
+}
+
+int MalahitClient::activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs, const size_t numElems)
+{
+  // Start with the next sample written
+  position = ring.getHead();
+  active   = true;
+  return(0);
+}
+
+int MalahitClient::deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
+{
+  active = false;
+  return(0);
+}
+
+int MalahitClient::readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs)
+{
+  if(!active) return(SOAPY_SDR_STREAM_ERROR);
+
+  unsigned long long dropped = ring.getDropped();
+  unsigned int result = ring.read((short *)buffs[0], numElems, position, timeNs, timeoutUs);
+
+  if(!result) return(ring.isAlive()? SOAPY_SDR_TIMEOUT : SOAPY_SDR_STREAM_ERROR);
+
+  flags = SOAPY_SDR_HAS_TIME;
+  if(ring.getDropped()!=dropped) flags |= SOAPY_SDR_END_ABRUPT;
+
+  return(result);
+}
+
+/*******************************************************************
+ * Frontend corrections API
+ ******************************************************************/
+
+bool MalahitClient::hasFrequencyCorrection(const int direction, const size_t channel) const
+{
+  return(true);
+}
+
+void MalahitClient::setFrequencyCorrection(const int direction, const size_t channel, const double value)
+{
+  request(IQServer::CMD_FREQ_CORRECTION, (int)value);
+}
+
+double MalahitClient::getFrequencyCorrection(const int direction, const size_t channel) const
+{
+  return(ring.getState().correction);
+}
+
+/*******************************************************************
+ * Gain API
+ ******************************************************************/
+
+std::vector<std::string> MalahitClient::listGains(const int direction, const size_t channel) const
+{
+  std::vector<std::string> result;
+
+  result.push_back("MAIN");
+
+  return(result);
+}
+
+void MalahitClient::setGain(const int direction, const size_t channel, const std::string &name, const double value)
+{
+  if(name=="MAIN") request(IQServer::CMD_GAIN, (int)(value * 10.0 + 0.5));
+}
+
+double MalahitClient::getGain(const int direction, const size_t channel, const std::string &name) const
+{
+  return(name=="MAIN"? ring.getState().gain : 0.0);
+}
+
+SoapySDR::Range MalahitClient::getGainRange(const int direction, const size_t channel, const std::string &name) const
+{
+  SharedRing::State state = ring.getState();
+
+  return((name=="MAIN") && state.gainCount?
+    SoapySDR::Range(state.gains[0], state.gains[state.gainCount-1]) : SoapySDR::Range(0.0, 0.0));
+}
+
+/*******************************************************************
+ * Frequency API
+ ******************************************************************/
+
+void MalahitClient::setFrequency(const int direction, const size_t channel, const std::string &name, const double frequency, const SoapySDR::Kwargs &args)
+{
+  // Timed retunes are not supported through the ring
+  if(name=="MAIN") request(IQServer::CMD_FREQUENCY, (unsigned int)frequency);
+}
+
+double MalahitClient::getFrequency(const int direction, const size_t channel, const std::string &name) const
+{
+  return(name=="MAIN"? ring.getState().frequency : 0.0);
+}
+
+std::vector<std::string> MalahitClient::listFrequencies(const int direction, const size_t channel) const
+{
+  std::vector<std::string> result;
+
+  result.push_back("MAIN");
+
+  return(result);
+}
+
+SoapySDR::RangeList MalahitClient::getFrequencyRange(const int direction, const size_t channel, const std::string &name) const
+{
+  SharedRing::State state = ring.getState();
+  SoapySDR::RangeList result;
+
+  if(name=="MAIN") result.push_back(SoapySDR::Range(state.minFrequency, state.maxFrequency));
+
+  return(result);
+}
+
+/*******************************************************************
+ * Sample Rate API
+ ******************************************************************/
+
+void MalahitClient::setSampleRate(const int direction, const size_t channel, const double rate)
+{
+  request(IQServer::CMD_SAMPLE_RATE, (unsigned int)rate);
+}
+
+double MalahitClient::getSampleRate(const int direction, const size_t channel) const
+{
+  return(ring.getState().sampleRate);
+}
+
+std::vector<double> MalahitClient::listSampleRates(const int direction, const size_t channel) const
+{
+  SharedRing::State state = ring.getState();
+  std::vector<double> result;
+
+  for(unsigned int j=0 ; (j<SharedRing::MAX_RATES) && state.rates[j] ; ++j)
+    result.push_back(state.rates[j]);
+
+  return(result);
+}
+
+/*******************************************************************
+ * Settings API
+ ******************************************************************/
+
+SoapySDR::ArgInfoList MalahitClient::getSettingInfo(void) const
+{
+  SoapySDR::ArgInfoList result;
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "shmStatus";
+    info.value = "";
+    info.name = "Shared memory status";
+    info.description = "Whether ring owner is alive and how many samples this client has missed.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  return(result);
+}
+
+std::string MalahitClient::readSetting(const std::string &key) const
+{
+  if(key=="shmStatus")
+  {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "alive=%s\nposition=%llu\ndropped=%llu\n",
+      ring.isAlive()? "true":"false", position, ring.getDropped());
+    return(buf);
+  }
+
+  return("");
+}
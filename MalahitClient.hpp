@@ -0,0 +1,136 @@
+#ifndef MALAHITCLIENT_HPP
+#define MALAHITCLIENT_HPP
+
+#include <SoapySDR/Device.hpp>
+
+#include "SharedRing.hpp"
+#include <string>
+
+//
+// Thin device attaching to a shared memory ring served by a process
+// that owns the actual Malahit hardware (see "shmServe" device arg).
+// Radio changes are requested from the owner, which serializes them.
+//
+class MalahitClient : public SoapySDR::Device
+{
+  public:
+    MalahitClient(const SoapySDR::Kwargs &args);
+
+    /*******************************************************************
+     * Identification API
+     ******************************************************************/
+
+    std::string getDriverKey(void) const;
+
+    std::string getHardwareKey(void) const;
+
+    SoapySDR::Kwargs getHardwareInfo(void) const;
+
+    /*******************************************************************
+     * Channels API
+     ******************************************************************/
+
+    size_t getNumChannels(const int direction) const;
+
+    /*******************************************************************
+     * Stream API
+     ******************************************************************/
+
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const;
+
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const;
+
+    SoapySDR::Stream *setupStream(const int direction,
+                                  const std::string &format,
+                                  const std::vector<size_t> &channels = std::vector<size_t>(),
+                                  const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    void closeStream(SoapySDR::Stream *stream);
+
+    size_t getStreamMTU(SoapySDR::Stream *stream) const;
+
+    int activateStream(SoapySDR::Stream *stream,
+                       const int flags = 0,
+                       const long long timeNs = 0,
+                       const size_t numElems = 0);
+
+    int deactivateStream(SoapySDR::Stream *stream, const int flags = 0, const long long timeNs = 0);
+
+    int readStream(SoapySDR::Stream *stream,
+                   void * const *buffs,
+                   const size_t numElems,
+                   int &flags,
+                   long long &timeNs,
+                   const long timeoutUs = 200000);
+
+    /*******************************************************************
+     * Frontend corrections API
+     ******************************************************************/
+
+    bool hasFrequencyCorrection(const int direction, const size_t channel) const;
+
+    void setFrequencyCorrection(const int direction, const size_t channel, const double value);
+
+    double getFrequencyCorrection(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Gain API
+     ******************************************************************/
+
+    std::vector<std::string> listGains(const int direction, const size_t channel) const;
+
+    void setGain(const int direction, const size_t channel, const std::string &name, const double value);
+
+    double getGain(const int direction, const size_t channel, const std::string &name) const;
+
+    SoapySDR::Range getGainRange(const int direction, const size_t channel, const std::string &name) const;
+
+    /*******************************************************************
+     * Frequency API
+     ******************************************************************/
+
+    void setFrequency(const int direction,
+                      const size_t channel,
+                      const std::string &name,
+                      const double frequency,
+                      const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
+    double getFrequency(const int direction, const size_t channel, const std::string &name) const;
+
+    std::vector<std::string> listFrequencies(const int direction, const size_t channel) const;
+
+    SoapySDR::RangeList getFrequencyRange(const int direction, const size_t channel, const std::string &name) const;
+
+    /*******************************************************************
+     * Sample Rate API
+     ******************************************************************/
+
+    void setSampleRate(const int direction, const size_t channel, const double rate);
+
+    double getSampleRate(const int direction, const size_t channel) const;
+
+    std::vector<double> listSampleRates(const int direction, const size_t channel) const;
+
+    /*******************************************************************
+     * Settings API
+     ******************************************************************/
+
+    SoapySDR::ArgInfoList getSettingInfo(void) const;
+
+    std::string readSetting(const std::string &key) const;
+
+  private:
+    std::string shmName;
+      // Name of the shared memory ring.
+    SharedRing ring;
+      // Ring we are attached to.
+    unsigned long long position = 0;
+      // Ring position of the next sample to read.
+    bool active = false;
+      // TRUE: stream is active.
+
+    void request(unsigned int command, unsigned int param);
+      // Send command to the ring owner, throw if it fails.
+};
+
+#endif // MALAHITCLIENT_HPP
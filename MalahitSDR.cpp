@@ -1,9 +1,15 @@
 #include "MalahitSDR.hpp"
+#include "MalahitClient.hpp"
+#include "Kernels.hpp"
 #include <SoapySDR/Registry.hpp>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
 
 static const unsigned int sampleRates[] =
 {
@@ -18,34 +24,238 @@ static const double gains[16] =
 //  4.8, 8.4, 6.5, 7.4, 9.3, 10.9, 11.8, 13.1
 };
 
-MalahitSDR::MalahitSDR()
+static std::mutex unitMutex;
+  // Protects data below.
+static std::map<std::string, SoapySDR::Kwargs> openUnits;
+  // Units open in this process, by SPI device name.
+static SoapySDR::KwargsList probeCache;
+  // Units found by the last probe.
+static unsigned long long probeTime = 0;
+  // Time of the last probe, in microseconds.
+static std::string probeKey;
+  // Arguments selecting the unit last probed.
+
+static const char *getArg(const SoapySDR::Kwargs &args, const char *key, const char *defValue)
+{
+  auto j = args.find(key);
+  return(j!=args.end()? j->second.c_str() : defValue);
+}
+
+static int getArg(const SoapySDR::Kwargs &args, const char *key, int defValue)
+{
+  auto j = args.find(key);
+  return(j!=args.end()? atoi(j->second.c_str()) : defValue);
+}
+
+static double getArg(const SoapySDR::Kwargs &args, const char *key, double defValue)
+{
+  auto j = args.find(key);
+  return(j!=args.end()? atof(j->second.c_str()) : defValue);
+}
+
+static unsigned int getPowerMode(const std::string &value)
 {
-  // Hard-reset attached hardware
-  stmDevice.reset();
-  // Check firmware and update as necessary
-  stmDevice.updateFirmware("/usr/share/malahit/" CURRENT_FIRMWARE);
-  // Start STM receiver
-  stmDevice.go();
+  return(value=="save"? PowerPolicy::POLICY_SAVE : value=="normal"? PowerPolicy::POLICY_NORMAL : PowerPolicy::POLICY_AUTO);
+}
+
+MalahitSDR::MalahitSDR(const SoapySDR::Kwargs &args)
+{
+  statusPipeName = getArg(args, "statusFile", "/tmp/battery");
+  idPipeName     = getArg(args, "idFile", "/tmp/stm-id");
+  alsaDeviceName = getArg(args, "alsa", "default");
+  spiDeviceName  = getArg(args, "spi", STM::DEFAULT_SPI);
+
+  // Capture from ALSA and control the STM, or generate samples without
+  // touching SPI and GPIO at all
+  if(!args.count("synthetic"))
+  {
+    alsaDevice.reset(new ALSA());
+    stmDevice.reset(new STM(
+      spiDeviceName.c_str(), 10000000,
+      getArg(args, "gpio", GPIO::DEFAULT_CHIP),
+      getArg(args, "rst", -1),
+      getArg(args, "busy", -1)
+    ));
+  }
+  else
+  {
+    synthetic = new Synthetic();
+    alsaDevice.reset(synthetic);
+    if(!synthetic->configure(args.at("synthetic"), !strcmp(getArg(args, "syntheticRealtime", "false"), "true")))
+      throw std::runtime_error("MalahitSDR invalid synthetic signal '" + args.at("synthetic") + "'");
+  }
+
+  // Collect statistics from all devices
+  alsaDevice->setMetrics(&metrics);
+  if(stmDevice) stmDevice->setMetrics(&metrics);
+
+  // Configure scheduling of capture and driver threads
+  captureRT.configure(getArg(args, "captureSched", ""), getArg(args, "capturePriority", 0), getArg(args, "captureCpus", ""));
+  controlRT.configure(getArg(args, "controlSched", ""), getArg(args, "controlPriority", 0), getArg(args, "controlCpus", ""));
+  lockBuffers = !strcmp(getArg(args, "mlock", "false"), "true");
+  hugePages   = !strcmp(getArg(args, "hugePages", "false"), "true");
+
+  // Pick vectorized kernels for this CPU, after checking them against scalar code
+  if(!Kernels::select(getArg(args, "simd", "auto")))
+    Kernels::select("auto");
+
+  // Keep history of recent samples for snapshots
+  historyFormat = !strcmp(getArg(args, "historyFormat", "cs16"), "lossless")? History::FORMAT_LOSSLESS : History::FORMAT_CS16;
+  historyLimit  = getArg(args, "historyLimit", (int)historyLimit);
+  if(args.count("history")) configureHistory(getArg(args, "history", 0.0));
+
+  // Read fuel gauge directly when asked to (i2c=on or i2c=DEVICE), keeping
+  // status polls off the SPI bus, not all units wire it to the host bus
+  const char *i2c = getArg(args, "i2c", "off");
+  if(!strcmp(i2c, "on")) i2c = SW6106::DEFAULT_I2C;
+  if(strcmp(i2c, "off"))
+    gauge.start(i2c, strtol(getArg(args, "i2cAddress", "0x3C"), 0, 0));
+
+  // Configure battery power saving
+  power.configure(getPowerMode(getArg(args, "powerPolicy", "auto")),
+    getArg(args, "powerSaveCharge", 30.0), getArg(args, "powerSaveVoltage", 3.5),
+    getArg(args, "batteryCapacity", 0.0));
+
+  // Optionally serve statistics to Prometheus
+  if(args.count("metricsSocket"))
+    metrics.startServer(args.at("metricsSocket").c_str(), &controlRT);
+
+  const char *firmwareFile = "/usr/share/malahit/" CURRENT_FIRMWARE;
+  unsigned int fileVersion = STM::getFileVersion(firmwareFile);
+  unsigned long long start = Metrics::now();
+  unsigned long long t = start;
+  unsigned int version;
+  bool loader;
+
+  // If STM is already running current firmware, skip restarting it,
+  // synthetic units have nothing to start. Unknown file version means
+  // the firmware cannot be checked, so start cold then.
+  bool warm = synthetic || ((!args.count("warmStart") || (args.at("warmStart")!="false"))
+           && fileVersion
+           && stmDevice->isReady()
+           && stmDevice->getStatus(0, 0, 0, 0, 0, &version, &loader)
+           && !loader && (version >= fileVersion));
+
+  fprintf(stderr, "MalahitSDR(): %s start, status took %llums\n", warm? "Warm" : "Cold", (Metrics::now() - t) / 1000);
+
+  if(!warm)
+  {
+    // Hard-reset attached hardware
+    t = Metrics::now();
+    stmDevice->reset();
+    fprintf(stderr, "MalahitSDR(): Reset took %llums\n", (Metrics::now() - t) / 1000);
+
+    // Check firmware and update changed pages as necessary
+    t = Metrics::now();
+    stmDevice->updateFirmware(firmwareFile, false, true);
+    fprintf(stderr, "MalahitSDR(): Firmware check took %llums\n", (Metrics::now() - t) / 1000);
+
+    // Start STM receiver
+    t = Metrics::now();
+    stmDevice->go();
+    fprintf(stderr, "MalahitSDR(): Startup took %llums\n", (Metrics::now() - t) / 1000);
+  }
+
   // Update hardware with initial settings
+  t = Metrics::now();
   updateRadio();
+  fprintf(stderr, "MalahitSDR(): Radio update took %llums\n", (Metrics::now() - t) / 1000);
+
+  fprintf(stderr, "MalahitSDR(): %s start took %llums total\n", warm? "Warm" : "Cold", (Metrics::now() - start) / 1000);
+
+  // Register this unit, so that discovery does not probe it
+  const char *id = synthetic? "synthetic" : stmDevice->getId();
+  serial = id? id : "";
+
+  SoapySDR::Kwargs unit;
+  unit["driver"] = "malahitrr";
+  unit["label"]  = "Malahit-RR " + serial;
+  unit["serial"] = serial;
+  unit["spi"]    = spiDeviceName;
+  unit["gpio"]   = getArg(args, "gpio", GPIO::DEFAULT_CHIP);
+  unit["alsa"]   = alsaDeviceName;
+  if(args.count("rst"))  unit["rst"]  = args.at("rst");
+  if(args.count("busy")) unit["busy"] = args.at("busy");
+
+  if(!synthetic)
+  {
+    std::lock_guard <std::mutex> lock(unitMutex);
+    openUnits[spiDeviceName] = unit;
+    probeTime = 0;
+  }
+
+  // Optionally serve IQ data to rtl_tcp clients
+  if(args.count("iqServer"))
+    iqServer.start(args.at("iqServer").c_str(), sizeof(gains) / sizeof(gains[0]),
+      [this](unsigned int command, unsigned int param) { serveCommand(command, param); },
+      getArg(args, "iqBacklog", (int)IQServer::DEFAULT_BACKLOG), &controlRT);
+
+  // Optionally serve IQ data to other processes via shared memory
+  // (shmMode sets octal permissions, owner and group by default)
+  if(args.count("shmServe") && shmRing.create(args.at("shmServe").c_str(), getArg(args, "shmSize", (int)SharedRing::DEFAULT_SIZE),
+       strtol(getArg(args, "shmMode", "0660"), 0, 8)))
+    publishState();
+
+  // Capture for servers while application is not streaming
+  if(iqServer.isRunning() || shmRing.isOpen())
+  {
+    iqRunning = true;
+    iqPump = std::thread(&MalahitSDR::pumpIQ, this);
+  }
 }
 
 MalahitSDR::~MalahitSDR()
 {
+  // Stop serving IQ data
+  if(iqPump.joinable())
+  {
+    iqRunning = false;
+    iqPump.join();
+  }
+  iqServer.stop();
+  shmRing.close();
+
+  // Unregister this unit and let discovery probe it again
+  if(!synthetic)
+  {
+    std::lock_guard <std::mutex> lock(unitMutex);
+    openUnits.erase(spiDeviceName);
+    probeTime = 0;
+  }
+
   // Close audio device
-  alsaDevice.close();
+  alsaDevice->close();
 }
 
 bool MalahitSDR::blinkLEDs(size_t samples)
 {
-  // Do not blink until accumulated enough time (1 second)
+  // Do not blink until accumulated enough time (longer when saving power)
   ledCount += samples;
-  if(ledCount<sampleRate*10) return(true);
+  if(ledCount<sampleRate*10*power.getStatusScale()) return(true);
   ledCount = 0;
 
+  // Save the SPI transaction when saving power, no LEDs when synthetic
+  if(power.isSaving() || synthetic) return(true);
+
   // Invert leds for now
   leds ^= LED_1;
-  return(stmDevice.leds(leds));
+  return(stmDevice->leds(leds));
+}
+
+bool MalahitSDR::configureHistory(double seconds)
+{
+  // Bound memory use, lossless blocks take about half the space
+  size_t bytes = (size_t)(seconds * sampleRate * (historyFormat==History::FORMAT_LOSSLESS? 2 : 4));
+  bytes = std::min(bytes, historyLimit * 1024 * 1024);
+
+  historySeconds = seconds;
+  if(!history.configure(bytes, historyFormat, chunkSize, hugePages)) return(false);
+
+  if(bytes)
+    fprintf(stderr, "configureHistory(): Keeping %zuMB of %s samples\n", bytes / 1024 / 1024,
+      historyFormat==History::FORMAT_LOSSLESS? "lossless" : "CS16");
+
+  return(true);
 }
 
 bool MalahitSDR::reportBattery(size_t samples)
@@ -56,32 +266,50 @@ bool MalahitSDR::reportBattery(size_t samples)
   bool charger;
   FILE *f;
 
-  // Do not report until accumulated enough time (10+ seconds)
+  // No battery to report when generating samples
+  if(synthetic) return(true);
+
+  // Do not report until accumulated enough time (10+ seconds, longer when saving power)
   statusCount += samples;
-  if(statusCount<sampleRate*10) return(true);
+  if(statusCount<sampleRate*10*power.getStatusScale()) return(true);
   statusCount = 0;
 
-  // Get STM status
+  // Get battery status from the fuel gauge, or from the STM otherwise
   char id[32], ch;
   unsigned int ver;
-  if(!stmDevice.getStatus(&voltage, &current, &charge, &ch, id, &ver)) return(false);
+  if(!gauge.getStatus(&voltage, &current, &charge, &ch))
+  {
+    if(!stmDevice->getStatus(&voltage, &current, &charge, &ch, id, &ver)) return(false);
+    stmId      = id;
+    stmVersion = ver;
+  }
+  else if(stmId.empty() && stmDevice->getStatus(0, 0, 0, 0, id, &ver))
+  {
+    // STM identity does not change, fetch it once
+    stmId      = id;
+    stmVersion = ver;
+  }
 
   // Determine charger status
   charger = ch!='\0';
 
+  // Switch power saving on or off
+  if(power.update(voltage, current, charge, charger))
+    fprintf(stderr, "reportBattery(): Power saving %s at %.2fV %d%%\n", power.isSaving()? "on" : "off", voltage, charge);
+
   // Light up a LED when the charge is too low
   leds = (leds ^ ~LED_2) | (!charger && (charge < 15)? LED_2:0);
 
   // Save STM chip ID and firmware version to a file
-  f = fopen(idPipeName, "wb");
+  f = fopen(idPipeName.c_str(), "wb");
   if(f)
   {
-    fprintf(f, "%s %.2f\n", id, ver / 100.0f);
+    fprintf(f, "%s %.2f\n", stmId.c_str(), stmVersion / 100.0f);
     fclose(f);
   }
 
   // This file will be used to report battery status
-  f = fopen(statusPipeName, "wb");
+  f = fopen(statusPipeName.c_str(), "wb");
   if(!f) return(false);
 
   // Report battery status
@@ -92,7 +320,7 @@ bool MalahitSDR::reportBattery(size_t samples)
   return(result);
 }
 
-bool MalahitSDR::updateRadio()
+bool MalahitSDR::updateRadio(Change change)
 {
   // Apply frequency correction
   unsigned int frequency = curFrequency * (1.0 + curFreqCorrection / 1000000.0);
@@ -101,7 +329,249 @@ bool MalahitSDR::updateRadio()
     sampleRate, frequency, switches, attenuator
   );
 
-  return(stmDevice.update(sampleRate, frequency, switches, attenuator, gain));
+  metrics.count(Metrics::RETUNES);
+
+  unsigned long long start = Metrics::now();
+  bool result = true;
+
+  // Synthetic signals follow tuning and gain, minus attenuation
+  if(synthetic)
+    synthetic->tune(frequency, gains[std::min(gain >> 1, 15U)] - attenuator);
+  else
+  {
+    result = stmDevice->update(sampleRate, frequency, switches, attenuator, gain, leds);
+
+    // Measure how long STM takes to apply the change
+    stmDevice->waitReady();
+  }
+  unsigned long long end = Metrics::now();
+
+  if(change!=CHANGE_NONE)
+  {
+    settleTotal[change] += end - start;
+    settleMax[change]    = std::max(settleMax[change], end - start);
+    settleCount[change] += 1;
+  }
+
+  // Samples captured before this time are stale
+  if(settleMode!=SETTLE_OFF) settleDeadline = end + settleMargin;
+
+  // Let shared memory clients know
+  publishState();
+
+  return(result);
+}
+
+void MalahitSDR::updateStale(ALSA *device)
+{
+  unsigned long long deadline = settleDeadline.exchange(0);
+  if(!deadline) return;
+
+  // Convert settling deadline to the stream position
+  unsigned long long now     = Metrics::now();
+  unsigned long long capture = sampleCount + device->getAvail();
+  unsigned long long pos;
+
+  if(deadline > now)
+    pos = capture + (deadline - now) * sampleRate / 1000000;
+  else
+    pos = capture - std::min(capture, (now - deadline) * sampleRate / 1000000);
+
+  staleUntil = std::max(staleUntil, pos);
+}
+
+void MalahitSDR::applyRetunes(ALSA *device, unsigned int lead)
+{
+  // Capture position is ahead of delivered samples by ALSA buffer contents
+  unsigned long long capture = sampleCount + device->getAvail();
+
+  // Retune will be due before we get control again, apply it now
+  while(!retunes.empty() && (retunes.front().sample <= capture + lead))
+  {
+    curFrequency = retunes.front().frequency;
+    retunes.erase(retunes.begin());
+    updateRadio(CHANGE_FREQUENCY);
+
+    // Retune takes effect at the capture position after the update
+    retuneIndex = sampleCount + device->getAvail();
+
+    fprintf(stderr, "applyRetunes(): Retuned to %.0fHz at sample %lld\n", curFrequency, retuneIndex);
+  }
+}
+
+bool MalahitSDR::runSweep(const std::string &params)
+{
+  double startFreq, stopFreq, binWidth;
+  unsigned int averages = 8;
+
+  if(sscanf(params.c_str(), "%lf:%lf:%lf:%u", &startFreq, &stopFreq, &binWidth, &averages) < 3)
+  {
+    fprintf(stderr, "runSweep(): Invalid sweep '%s'!\n", params.c_str());
+    return(false);
+  }
+
+  std::lock_guard <std::mutex> lock(mutex);
+
+  startFreq = std::max(startFreq, (double)minFrequency);
+  stopFreq  = std::min(stopFreq, (double)maxFrequency);
+
+  // Sweeping holds the lock and retunes throughout, which streams and
+  // servers cannot live with, so only sweep while they are idle
+  if(appStream || pumpStream || alsaDevice->isOpen())
+  {
+    fprintf(stderr, "runSweep(): Cannot sweep while streaming!\n");
+    return(false);
+  }
+
+  // Use ALSA device directly
+  if(!alsaDevice->open(alsaDeviceName.c_str(), sampleRate, chunkCount * chunkSize, chunkSize))
+    return(false);
+
+  unsigned int chunk = alsaDevice->getChunkSize();
+
+  // Use a single worker when saving power
+  unsigned int workers = power.isSaving()? 1 : std::max(1U, std::thread::hardware_concurrency());
+  if(!sweep || (sweep->getWorkerCount()!=workers)) sweep.reset(new Sweep(workers, &controlRT));
+  if(!sweep->plan(startFreq, stopFreq, binWidth, sampleRate, averages, chunk))
+  {
+    alsaDevice->close();
+    return(false);
+  }
+
+  fprintf(stderr, "runSweep(): Sweeping %.0f..%.0fHz in %u steps...\n", startFreq, stopFreq, sweep->getStepCount());
+
+  double savedFrequency = curFrequency;
+  unsigned long long start = Metrics::now();
+  unsigned int size = sweep->getCaptureSize();
+
+  // Workers process previous steps while we retune and capture next ones
+  for(unsigned int step=0 ; step<sweep->getStepCount() ; ++step)
+  {
+    short *buffer = sweep->getBuffer();
+
+    curFrequency = sweep->getStepFrequency(step);
+    updateRadio(CHANGE_FREQUENCY);
+
+    // Drop samples captured before retuning and during settling
+    unsigned int stale = alsaDevice->getAvail() + settleMargin * (unsigned long long)sampleRate / 1000000;
+    for(unsigned int j=0, n ; j<stale ; j+=n)
+      if(!(n = alsaDevice->read(buffer, chunk))) break; else sampleCount += n;
+
+    // Capture samples at this step, keeping stream time running
+    sampleCount += alsaDevice->read(buffer, size);
+    sweep->submit(step, buffer);
+  }
+
+  sweepResult = sweep->finish((Metrics::now() - start) / 1000000.0);
+
+  // Restore previous state
+  curFrequency = savedFrequency;
+  updateRadio(CHANGE_FREQUENCY);
+  alsaDevice->close();
+
+  fprintf(stderr, "runSweep(): %s", sweepResult.substr(0, sweepResult.find('\n') + 1).c_str());
+  return(true);
+}
+
+bool MalahitSDR::serveCommand(unsigned int command, unsigned int param)
+{
+  switch(command)
+  {
+    case IQServer::CMD_FREQUENCY:
+      if((param<minFrequency) || (param>maxFrequency)) return(false);
+      setFrequency(SOAPY_SDR_RX, 0, param);
+      return(true);
+    case IQServer::CMD_SAMPLE_RATE:
+      setSampleRate(SOAPY_SDR_RX, 0, param);
+      return(getSampleRate(SOAPY_SDR_RX, 0)==param);
+    case IQServer::CMD_GAIN_MODE:
+      setGainMode(SOAPY_SDR_RX, 0, !param);
+      return(true);
+    case IQServer::CMD_GAIN:
+      setGain(SOAPY_SDR_RX, 0, (int)param / 10.0);
+      return(true);
+    case IQServer::CMD_FREQ_CORRECTION:
+      setFrequencyCorrection(SOAPY_SDR_RX, 0, (int)param);
+      return(true);
+    case IQServer::CMD_GAIN_INDEX:
+      if(param >= sizeof(gains) / sizeof(gains[0])) return(false);
+      setGain(SOAPY_SDR_RX, 0, gains[param]);
+      return(true);
+    default:
+      // Other rtl_tcp commands have no equivalent here
+      return(false);
+  }
+}
+
+bool MalahitSDR::serveRequest(unsigned int command, unsigned int param)
+{
+  // Requests from all clients get serialized here
+  bool result = serveCommand(command, param);
+
+  std::lock_guard <std::mutex> lock(mutex);
+  publishState();
+  return(result);
+}
+
+void MalahitSDR::publishState()
+{
+  SharedRing::State state;
+  unsigned int j;
+
+  if(!shmRing.isOpen()) return;
+
+  memset(&state, 0, sizeof(state));
+  state.frequency    = curFrequency;
+  state.gain         = gains[std::min(gain >> 1, 15U)];
+  state.correction   = curFreqCorrection;
+  state.minFrequency = minFrequency;
+  state.maxFrequency = maxFrequency;
+  state.sampleRate   = sampleRate;
+
+  for(j=0 ; sampleRates[j] && (j<SharedRing::MAX_RATES-1) ; ++j)
+    state.rates[j] = sampleRates[j];
+
+  state.gainCount = sizeof(gains) / sizeof(gains[0]);
+  for(j=0 ; j<state.gainCount ; ++j)
+    state.gains[j] = gains[j];
+
+  shmRing.setState(state);
+}
+
+void MalahitSDR::pumpIQ()
+{
+  while(iqRunning)
+  {
+    {
+      std::lock_guard <std::mutex> lock(mutex);
+
+      // Application owns the capture now, leave it alone
+      if(appStream) pumpStream = false;
+
+      // Capture while clients are connected and application is not streaming
+      bool wanted = !appStream && (iqServer.getClientCount() || shmRing.isOpen());
+
+      if(wanted && !pumpStream)
+        pumpStream = openStream(alsaDevice.get())>=0;
+      else if(!wanted && pumpStream)
+      {
+        alsaDevice->close();
+        pumpStream = false;
+      }
+
+      // Captured blocks get published to the servers
+      if(pumpStream) capture();
+    }
+
+    // Execute shared memory client requests
+    shmRing.serve([this](unsigned int command, unsigned int param) { return(serveRequest(command, param)); });
+
+    if(!pumpStream) usleep(10000);
+  }
+
+  std::lock_guard <std::mutex> lock(mutex);
+  if(pumpStream) alsaDevice->close();
+  pumpStream = false;
 }
 
 /*******************************************************************
@@ -122,7 +592,9 @@ SoapySDR::Kwargs MalahitSDR::getHardwareInfo(void) const
 {
   SoapySDR::Kwargs result;
 
-  // @@@ TODO!
+  result["serial"] = serial;
+  result["spi"]    = spiDeviceName;
+  result["alsa"]   = alsaDeviceName;
 
   return(result);
 }
@@ -145,21 +617,69 @@ std::vector<std::string> MalahitSDR::getStreamFormats(const int direction, const
 {
   std::vector<std::string> result;
 
-  // We only support one channel, with CS16 data
-  if(direction!=0 && channel==0) result.push_back("CS16");
+  // We only support one channel, with CS16 data converted as requested
+  if(direction!=0 && channel==0)
+  {
+    result.push_back("CS16");
+    result.push_back("CF32");
+  }
 
   return(result);
 }
 
 std::string MalahitSDR::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
 {
-  // We only support CS16 data format
+  // Hardware delivers CS16 data
+  fullScale = 32768;
   return("CS16");
 }
 
 SoapySDR::ArgInfoList MalahitSDR::getStreamArgsInfo(const int direction, const size_t channel) const
 {
   SoapySDR::ArgInfoList result;
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "dsp";
+    info.value = "";
+    info.name = "DSP chain";
+    info.description = "Comma-separated processing stages: dc (DC blocker), shift (frequency shift), decimate (averaging decimator). Chains in this order run as one fused pass.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "shift";
+    info.value = "0";
+    info.name = "Frequency shift";
+    info.description = "Frequency moved to zero by the shift stage.";
+    info.units = "Hz";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "decimation";
+    info.value = "1";
+    info.name = "Decimation";
+    info.description = "Decimation factor of the decimate stage. Stream time stays in input samples.";
+    info.type = SoapySDR::ArgInfo::INT;
+    info.range = SoapySDR::Range(1, 256);
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "fuse";
+    info.value = "true";
+    info.name = "Fuse DSP chain";
+    info.description = "Run the DSP chain as one fused pass when possible. Disable to time each stage separately.";
+    info.type = SoapySDR::ArgInfo::BOOL;
+    result.push_back(info);
+  }
+
   return(result);
 }
 
@@ -169,20 +689,30 @@ SoapySDR::Stream *MalahitSDR::setupStream(const int direction, const std::string
   if((direction==0) || (channels.size()>1) || ((channels.size()>0) && (channels.at(0)>0)))
     throw std::runtime_error("setupStream invalid channel selection");
 
-  // We only support CS16 data format
-  if(format!="CS16")
+  // We support CS16 and CF32 data formats
+  if((format!="CS16") && (format!="CF32"))
     throw std::runtime_error("setupStream invalid format '" + format + "'");
 
-  // Return our ALSA device (may not be open yet)
-  return(reinterpret_cast<SoapySDR::Stream *>(&alsaDevice));
+  // Each stream reads the shared capture at its own pace, through its own DSP chain
+  std::unique_ptr<StreamHandle> handle(new StreamHandle());
+  if(!handle->pipeline.configure(format=="CF32"? Pipeline::OUTPUT_CF32 : Pipeline::OUTPUT_CS16, args))
+    throw std::runtime_error(std::string("setupStream invalid DSP chain '") + getArg(args, "dsp", "") + "'");
+
+  std::lock_guard <std::mutex> lock(mutex);
+  streams.push_back(std::move(handle));
+  return(reinterpret_cast<SoapySDR::Stream *>(streams.back().get()));
 }
 
 void MalahitSDR::closeStream(SoapySDR::Stream *stream)
 {
   std::lock_guard <std::mutex> lock(mutex);
+  StreamHandle *handle = reinterpret_cast<StreamHandle *>(stream);
 
-  // Close ALSA device
-  (reinterpret_cast<ALSA *>(stream))->close();
+  for(auto j=streams.begin() ; j!=streams.end() ; ++j)
+    if(j->get()==handle) { streams.erase(j);break; }
+
+  // Stop capture once no streams remain active
+  updateCapture();
 }
 
 size_t MalahitSDR::getStreamMTU(SoapySDR::Stream *stream) const
@@ -194,35 +724,250 @@ size_t MalahitSDR::getStreamMTU(SoapySDR::Stream *stream) const
 int MalahitSDR::activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs, const size_t numElems)
 {
   std::lock_guard <std::mutex> lock(mutex);
+  StreamHandle *handle = reinterpret_cast<StreamHandle *>(stream);
+
+  // Join capture already running for other streams or servers
+  if(!alsaDevice->isOpen() && (openStream(alsaDevice.get())<0)) return(-1);
+
+  // Size DSP buffers here, readStream() must not allocate
+  handle->pipeline.prepare(alsaDevice->getChunkSize());
+
+  // Start with the next captured block
+  handle->block  = blockCount;
+  handle->offset = 0;
+  handle->active = true;
+
+  // Application takes over the capture from the servers
+  appStream = true;
+  return(0);
+}
+
+int MalahitSDR::openStream(ALSA *device)
+{
+  // Restart stream time
+  sampleCount = 0;
+  timeBase    = 0;
+  retuneIndex = -1;
+  staleUntil  = 0;
+
+  // Open ALSA device, with longer periods when saving power
+  unsigned int period = chunkSize * power.getPeriodScale();
+  if(!device->open(alsaDeviceName.c_str(), sampleRate, chunkCount * period, period)) return(-1);
 
-  // Open ALSA device
-  ALSA *device = reinterpret_cast<ALSA *>(stream);
-  return(device->open(alsaDeviceName, sampleRate, chunkCount * chunkSize, chunkSize)? 0 : -1);
+  // Allocate stream buffers once, readStream() must not allocate
+  unsigned int chunk = device->getChunkSize();
+  size_t bytes = (RING_BLOCKS + 1) * (2 * chunk * sizeof(short) + BufferPool::ALIGNMENT);
+  if(!pool.reserve(bytes, hugePages)) return(-1);
+
+  // Buffer for dropped samples
+  scratch = pool.get<short>(2 * chunk);
+
+  // Ring of captured blocks shared by all streams
+  blockSize = chunk;
+  for(unsigned int j=0 ; j<RING_BLOCKS ; ++j)
+  {
+    blocks[j].data  = pool.get<short>(2 * chunk);
+    blocks[j].count = 0;
+  }
+
+  // Keep stream buffers resident
+  if(lockBuffers)
+    lockStatus = pool.lock()? "applied" : "failed";
+
+  // Apply capture scheduling on the first read
+  captureApplied = false;
+  return(0);
+}
+
+void MalahitSDR::updateCapture()
+{
+  appStream = false;
+  for(auto &handle: streams) appStream = appStream || handle->active;
+
+  // Close ALSA device unless servers are using it, they may reopen it
+  if(!appStream && !pumpStream) alsaDevice->close();
 }
 
 int MalahitSDR::deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs)
 {
   std::lock_guard <std::mutex> lock(mutex);
 
-  // Close ALSA device
-  ALSA *device = reinterpret_cast<ALSA *>(stream);
-  device->close();
+  reinterpret_cast<StreamHandle *>(stream)->active = false;
+  updateCapture();
   return(0);
 }
 
-int MalahitSDR::readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs)
+bool MalahitSDR::capture()
 {
-  std::lock_guard <std::mutex> lock(mutex);
+  ALSA *device = alsaDevice.get();
+  unsigned int chunk = device->getChunkSize();
+  Block &block = blocks[blockCount % RING_BLOCKS];
+
+  if(!device->isOpen() || !block.data) return(false);
+
+  // Never read past blocks carved for a shorter period
+  if(chunk > blockSize)
+  {
+    fprintf(stderr, "MalahitSDR::capture(): Period %u exceeds %u sample blocks!\n", chunk, blockSize);
+    return(false);
+  }
+
+  // Apply scheduling to the capture thread
+  if(!captureApplied && captureRT.isConfigured()) captureRT.apply();
+  captureApplied = true;
 
   // Report SW6106 status
-  reportBattery(numElems);
+  reportBattery(chunk);
 
   // Blink LEDs
-  blinkLEDs(numElems);
+  blinkLEDs(chunk);
+
+  // Apply timed retunes due before the next capture
+  applyRetunes(device, chunk);
+
+  // Find where samples affected by the last change end
+  updateStale(device);
+
+  // Drop whole chunks of stale samples
+  if((settleMode==SETTLE_DROP) && scratch)
+    while(sampleCount + chunk <= staleUntil)
+    {
+      unsigned int dropped = device->read(scratch, chunk);
+      if(!dropped) break;
+      sampleCount += dropped;
+    }
+
+  // Flag blocks starting with stale samples
+  bool stale = (settleMode!=SETTLE_OFF) && (sampleCount < staleUntil);
 
   // Read data from the ALSA device
-  ALSA *device = reinterpret_cast<ALSA *>(stream);
-  return(device->read(buffs[0], numElems/16));
+  unsigned int result = device->read(block.data, chunk);
+  if(!result) return(false);
+
+  // Measure levels and clipping as delivered by the ADC
+  signalStats.process(block.data, result);
+
+  // Blank impulses at full rate, before anything spreads them
+  if(blanker.isEnabled() && !power.isSaving())
+  {
+    unsigned long long start = Metrics::now();
+    blanker.process(block.data, result, sampleRate);
+    metrics.time(Metrics::NOISE_BLANKER, Metrics::now() - start);
+  }
+
+  // Record stream time of the first sample
+  block.count  = result;
+  block.rate   = sampleRate;
+  block.timeNs = timeBase + (long long)(sampleCount * 1000000000.0 / sampleRate);
+  block.flags  = SOAPY_SDR_HAS_TIME;
+
+  // Mark the block where the last timed retune took effect
+  if((retuneIndex >= (long long)sampleCount) && (retuneIndex < (long long)(sampleCount + result)))
+    block.flags |= SOAPY_SDR_USER_FLAG0;
+
+  // Mark the block containing samples captured before settling
+  if(stale) block.flags |= SOAPY_SDR_USER_FLAG1;
+
+  sampleCount += result;
+  blockCount++;
+
+  // Flag blocks with signal activity, optionally gating quiet ones,
+  // flagging alone is skipped when saving power
+  bool quiet = false;
+  if((activityMode==ACTIVITY_GATE) || ((activityMode==ACTIVITY_FLAG) && !power.isSaving()))
+  {
+    if(activity.process(block.data, result, sampleRate))
+      block.flags |= SOAPY_SDR_USER_FLAG2;
+    else
+      quiet = activityMode==ACTIVITY_GATE;
+  }
+
+  // Keep recent samples for snapshots, gated or not
+  if(history.isEnabled())
+    history.write(block.data, result, sampleRate, block.timeNs, curFrequency, block.flags & SOAPY_SDR_USER_FLAG2);
+
+  // Fan samples out to IQ server and shared memory clients
+  if(!quiet)
+  {
+    iqServer.publish(block.data, result);
+    shmRing.write(block.data, result, block.timeNs);
+  }
+
+  return(true);
+}
+
+int MalahitSDR::readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs)
+{
+  std::lock_guard <std::mutex> lock(mutex);
+  StreamHandle *handle = reinterpret_cast<StreamHandle *>(stream);
+  unsigned long long start = Metrics::now();
+  unsigned int result = 0;
+
+  if(!handle->active) return(SOAPY_SDR_STREAM_ERROR);
+  if(!numElems) return(0);
+
+  // A decimator may consume whole blocks without output, keep going
+  // until there is some, flagging it with everything it spans
+  flags = 0;
+  for(unsigned int pass=0 ; !result ; ++pass)
+  {
+    // Stream that caught up with the capture captures the next block,
+    // partial input stays pending in the decimator on timeout
+    if(handle->block==blockCount)
+    {
+      if(pass && ((long long)(Metrics::now() - start) >= timeoutUs)) return(SOAPY_SDR_TIMEOUT);
+      if(!capture()) return(SOAPY_SDR_TIMEOUT);
+    }
+
+    // Stream fell behind and its data got overwritten, skip to the oldest block
+    if(blockCount - handle->block > RING_BLOCKS)
+    {
+      handle->block  = blockCount - RING_BLOCKS;
+      handle->offset = 0;
+      return(SOAPY_SDR_OVERFLOW);
+    }
+
+    // Deliver samples from the current block through the stream DSP chain
+    const Block &block = blocks[handle->block % RING_BLOCKS];
+    const short *data  = block.data + 2 * handle->offset;
+    unsigned int input   = std::min((size_t)(block.count - handle->offset), (size_t)handle->pipeline.getInputLimit(numElems));
+    unsigned int pending = handle->pipeline.getPending();
+    result = handle->pipeline.process(data, buffs[0], input, block.rate);
+
+    // First output averages samples left pending from earlier input
+    timeNs = block.timeNs + (long long)(((long long)handle->offset - pending) * 1000000000.0 / block.rate);
+    flags |= block.flags;
+
+    // Advance to the next block once this one has been consumed
+    handle->offset += input;
+    if(handle->offset>=block.count)
+    {
+      handle->block++;
+      handle->offset = 0;
+    }
+  }
+
+  metrics.time(Metrics::READ_STREAM, Metrics::now() - start);
+  return(result);
+}
+
+/*******************************************************************
+ * Time API
+ ******************************************************************/
+
+bool MalahitSDR::hasHardwareTime(const std::string &what) const
+{
+  // Stream time is counted in samples
+  return(what.empty());
+}
+
+long long MalahitSDR::getHardwareTime(const std::string &what) const
+{
+  std::lock_guard <std::mutex> lock(mutex);
+
+  // Time of the sample being captured now
+  unsigned long long capture = sampleCount + alsaDevice->getAvail();
+  return(timeBase + (long long)(capture * 1000000000.0 / sampleRate));
 }
 
 /*******************************************************************
@@ -266,12 +1011,13 @@ std::vector<std::string> MalahitSDR::listAntennas(const int direction, const siz
 
 void MalahitSDR::setAntenna(const int direction, const size_t channel, const std::string &name)
 {
+  std::lock_guard <std::mutex> lock(mutex);
   bool loop = name == "Loop";
 
   if(loop != !!(switches & SW_LOOP))
   {
     switches = (switches & ~SW_LOOP) | (loop? SW_LOOP : 0);
-    updateRadio();
+    updateRadio(CHANGE_SWITCHES);
   }
 }
 
@@ -297,10 +1043,12 @@ bool MalahitSDR::hasFrequencyCorrection(const int direction, const size_t channe
 
 void MalahitSDR::setFrequencyCorrection(const int direction, const size_t channel, const double value)
 {
+  std::lock_guard <std::mutex> lock(mutex);
+
   if(value != curFreqCorrection)
   {
     curFreqCorrection = value;
-    updateRadio();
+    updateRadio(CHANGE_FREQUENCY);
   }
 }
 
@@ -356,10 +1104,11 @@ void MalahitSDR::setGain(const int direction, const size_t channel, const std::s
   // @@@ LSB is not gain
   i <<= 1;
 
+  std::lock_guard <std::mutex> lock(mutex);
   if((name=="MAIN") && (i!=gain))
   {
     gain = i;
-    updateRadio();
+    updateRadio(CHANGE_GAIN);
   }
 }
 
@@ -395,12 +1144,31 @@ void MalahitSDR::setFrequency(const int direction, const size_t channel, const d
 
 void MalahitSDR::setFrequency(const int direction, const size_t channel, const std::string &name, const double frequency, const SoapySDR::Kwargs &args)
 {
+  // If retune is timed, queue it until the stream gets there
+  if(args.count("timeNs") || args.count("sample"))
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    Retune retune;
+
+    retune.frequency = frequency;
+    retune.sample    = args.count("sample")? stoull(args.at("sample"))
+      : std::max(0.0, (stoll(args.at("timeNs")) - timeBase) * (double)sampleRate / 1000000000.0);
+
+    // Keep retunes in stream order
+    auto j = retunes.begin();
+    while((j!=retunes.end()) && (j->sample <= retune.sample)) ++j;
+    retunes.insert(j, retune);
+    return;
+  }
+
+  std::lock_guard <std::mutex> lock(mutex);
+
   // If frequency changes...
   if(frequency != curFrequency)
   {
     // New frequency now in effect
     curFrequency = frequency;
-    updateRadio();
+    updateRadio(CHANGE_FREQUENCY);
   }
 }
 
@@ -448,16 +1216,36 @@ SoapySDR::RangeList MalahitSDR::getFrequencyRange(const int direction, const siz
 
 SoapySDR::ArgInfoList MalahitSDR::getFrequencyArgsInfo(const int direction, const size_t channel) const
 {
-  // No frequency args yet
   SoapySDR::ArgInfoList result;
-  return(result);
-}
-
-/*******************************************************************
- * Sample Rate API
- ******************************************************************/
 
-void MalahitSDR::setSampleRate(const int direction, const size_t channel, const double rate)
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "timeNs";
+    info.value = "0";
+    info.name = "Retune time";
+    info.description = "Stream time in nanoseconds to retune at.";
+    info.type = SoapySDR::ArgInfo::INT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "sample";
+    info.value = "0";
+    info.name = "Retune sample";
+    info.description = "Stream sample index to retune at.";
+    info.type = SoapySDR::ArgInfo::INT;
+    result.push_back(info);
+  }
+
+  return(result);
+}
+
+/*******************************************************************
+ * Sample Rate API
+ ******************************************************************/
+
+void MalahitSDR::setSampleRate(const int direction, const size_t channel, const double rate)
 {
   unsigned int newRate = (unsigned int)rate;
   int j;
@@ -473,16 +1261,28 @@ void MalahitSDR::setSampleRate(const int direction, const size_t channel, const
     fprintf(stderr, "setSampleRate(%d): Setting new rate...\n", newRate);
 
     // Close ALSA device while changing sample rate
-    bool needReopen = alsaDevice.isOpen();
-    if(needReopen) alsaDevice.close();
+    bool needReopen = alsaDevice->isOpen();
+    if(needReopen) alsaDevice->close();
+
+    // Keep stream time continuous across the rate change
+    for(auto &retune: retunes)
+      retune.sample = retune.sample <= sampleCount? 0
+        : (retune.sample - sampleCount) * (double)newRate / sampleRate;
+
+    timeBase   += (long long)(sampleCount * 1000000000.0 / sampleRate);
+    sampleCount = 0;
+    retuneIndex = -1;
+    staleUntil  = 0;
 
     // Change sample rate
     sampleRate = newRate;
-    updateRadio();
+    updateRadio(CHANGE_RATE);
 
-    // Reopen ALSA device
+    // Reopen ALSA device with the running period, blocks were carved
+    // for it and a new one only applies at the next openStream()
+    unsigned int period = blockSize? blockSize : chunkSize;
     if(needReopen)
-      alsaDevice.open(alsaDeviceName, sampleRate, chunkCount * chunkSize, chunkSize);
+      alsaDevice->open(alsaDeviceName.c_str(), sampleRate, chunkCount * period, period);
 
     fprintf(stderr, "setSampleRate(%d): DONE!\n", newRate);
   }
@@ -540,6 +1340,80 @@ bool MalahitSDR::hasDCOffset(const int direction, const size_t channel) const
   return(false);
 }
 
+/*******************************************************************
+ * Sensor API
+ ******************************************************************/
+
+std::vector<std::string> MalahitSDR::listSensors(void) const
+{
+  std::vector<std::string> result;
+  result.push_back("rmsI");
+  result.push_back("rmsQ");
+  result.push_back("peakI");
+  result.push_back("peakQ");
+  result.push_back("clipI");
+  result.push_back("clipQ");
+  result.push_back("overload");
+  return(result);
+}
+
+SoapySDR::ArgInfo MalahitSDR::getSensorInfo(const std::string &key) const
+{
+  SoapySDR::ArgInfo info;
+  bool q = !key.empty() && (key.back()=='Q');
+
+  info.key   = key;
+  info.value = "0";
+
+  if(key=="rmsI" || key=="rmsQ")
+  {
+    info.name = q? "Q RMS level" : "I RMS level";
+    info.description = "RMS level of the last captured block, relative to a full scale sine.";
+    info.units = "dBFS";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+  }
+  else if(key=="peakI" || key=="peakQ")
+  {
+    info.name = q? "Q peak level" : "I peak level";
+    info.description = "Peak level of the last captured block.";
+    info.units = "dBFS";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+  }
+  else if(key=="clipI" || key=="clipQ")
+  {
+    info.name = q? "Q clipped samples" : "I clipped samples";
+    info.description = "Samples at full scale in the last captured block.";
+    info.units = "samples";
+    info.type = SoapySDR::ArgInfo::INT;
+  }
+  else if(key=="overload")
+  {
+    info.value = "false";
+    info.name = "ADC overload";
+    info.description = "Last captured block had clipped samples.";
+    info.type = SoapySDR::ArgInfo::BOOL;
+  }
+
+  return(info);
+}
+
+std::string MalahitSDR::readSensor(const std::string &key) const
+{
+  std::lock_guard <std::mutex> lock(mutex);
+  const SignalStats::Channel &i = signalStats.getI();
+  const SignalStats::Channel &q = signalStats.getQ();
+
+  if(key=="rmsI")     return std::to_string(i.rms);
+  if(key=="rmsQ")     return std::to_string(q.rms);
+  if(key=="peakI")    return std::to_string(i.peak);
+  if(key=="peakQ")    return std::to_string(q.peak);
+  if(key=="clipI")    return std::to_string(i.clipped);
+  if(key=="clipQ")    return std::to_string(q.clipped);
+  if(key=="overload") return (i.clipped || q.clipped)? "true" : "false";
+
+  return("");
+}
+
 /*******************************************************************
  * Settings API
  ******************************************************************/
@@ -608,6 +1482,324 @@ SoapySDR::ArgInfoList MalahitSDR::getSettingInfo(void) const
     result.push_back(info);
   }
 
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "retuneIndex";
+    info.value = "-1";
+    info.name = "Retune index";
+    info.description = "Stream sample index where the last timed retune took effect.";
+    info.type = SoapySDR::ArgInfo::INT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "settleMode";
+    info.value = "off";
+    info.name = "Settle mode";
+    info.description = "Handling of samples captured before changes settle: off, tag (SOAPY_SDR_USER_FLAG1), drop.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    info.options = { "off", "tag", "drop" };
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "settleMargin";
+    info.value = "0";
+    info.name = "Settle margin";
+    info.description = "Extra settling time after STM applies a change.";
+    info.units = "us";
+    info.type = SoapySDR::ArgInfo::INT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "settleTimes";
+    info.value = "";
+    info.name = "Settle times";
+    info.description = "Measured STM settling times by change type.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "history";
+    info.value = "0";
+    info.name = "History";
+    info.description = "Seconds of recent samples kept in memory for snapshots, 0 to disable. Memory is bounded by the historyLimit argument (MB). Reading returns history and last snapshot status.";
+    info.units = "s";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    info.range = SoapySDR::Range(0.0, 600.0);
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "snapshot";
+    info.value = "";
+    info.name = "Snapshot";
+    info.description = "Write history plus snapshotPost seconds of new samples to PATH.sigmf-data and PATH.sigmf-meta in the background, without interrupting streams.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "snapshotPost";
+    info.value = "10";
+    info.name = "Snapshot post-trigger time";
+    info.description = "Samples captured after the snapshot request that are added to it.";
+    info.units = "s";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    result.push_back(info);
+  }
+
+  if(synthetic)
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "synthetic";
+    info.value = "";
+    info.name = "Synthetic source";
+    info.description = "Generated signal components, ADC errors and generation throughput, set by the synthetic argument.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "signal";
+    info.value = "";
+    info.name = "Signal statistics";
+    info.description = "RMS, peak and clipped samples of the last block for I and Q, clipping totals, and histograms of block RMS and peak levels in 6dB steps from full scale. Write 'reset' to clear.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "telemetry";
+    info.value = "";
+    info.name = "Battery telemetry";
+    info.description = "Battery status source (sw6106 over I2C, or stm over SPI), with fuel gauge poll and error counts.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "powerPolicy";
+    info.value = "auto";
+    info.name = "Power policy";
+    info.description = "Battery power saving: auto (on battery below thresholds), normal (never), save (always). Saving skips the noise blanker and activity flagging, reports battery and blinks LEDs less, sweeps with one worker, and opens ALSA with longer periods.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    info.options = { "auto", "normal", "save" };
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "powerSaveCharge";
+    info.value = "30";
+    info.name = "Power saving charge";
+    info.description = "Battery charge below which power saving starts.";
+    info.units = "%";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    info.range = SoapySDR::Range(0.0, 100.0);
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "powerSaveVoltage";
+    info.value = "3.5";
+    info.name = "Power saving voltage";
+    info.description = "Battery voltage below which power saving starts.";
+    info.units = "V";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "power";
+    info.value = "";
+    info.name = "Power status";
+    info.description = "Power policy state, battery status, CPU wakeups per second, estimated runtime, and ALSA period.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "dsp";
+    info.value = "";
+    info.name = "DSP timing";
+    info.description = "DSP chain of each stream with time spent per stage, or per fused kernel. Write 'reset' to clear.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "simd";
+    info.value = "auto";
+    info.name = "SIMD kernels";
+    info.description = "Instruction set used by vectorized kernels. Reading returns supported sets, the one in use, and self-test results with time per sample.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    info.options = { "auto", "scalar", "neon", "sse4.1", "avx2" };
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "noiseBlanker";
+    info.value = "off";
+    info.name = "Noise blanker";
+    info.description = "Impulse noise blanker: off, blank (zero impulses), interpolate (bridge impulses between good samples).";
+    info.type = SoapySDR::ArgInfo::STRING;
+    info.options = { "off", "blank", "interpolate" };
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "noiseBlankerThreshold";
+    info.value = "8";
+    info.name = "Noise blanker threshold";
+    info.description = "Envelope, relative to its running average, considered an impulse.";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    info.range = SoapySDR::Range(1.0, 100.0);
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "noiseBlankerWidth";
+    info.value = "16";
+    info.name = "Noise blanker width";
+    info.description = "Samples blanked after the envelope drops below threshold.";
+    info.units = "samples";
+    info.type = SoapySDR::ArgInfo::INT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "noiseBlankerStatus";
+    info.value = "";
+    info.name = "Noise blanker status";
+    info.description = "Blanker settings, average envelope, impulse count, and share of blanked samples.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "activityMode";
+    info.value = "off";
+    info.name = "Activity mode";
+    info.description = "Signal activity detection: off, flag (SOAPY_SDR_USER_FLAG2 on active blocks), gate (also keep quiet blocks off IQ and shared memory servers).";
+    info.type = SoapySDR::ArgInfo::STRING;
+    info.options = { "off", "flag", "gate" };
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "activityThreshold";
+    info.value = "10";
+    info.name = "Activity threshold";
+    info.description = "Energy above noise floor considered activity.";
+    info.units = "dB";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "activityFlatness";
+    info.value = "0.5";
+    info.name = "Activity flatness";
+    info.description = "Spectral flatness below which signal is considered active, 1.0 being white noise.";
+    info.type = SoapySDR::ArgInfo::FLOAT;
+    info.range = SoapySDR::Range(0.0, 1.0);
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "activityHang";
+    info.value = "500";
+    info.name = "Activity hang time";
+    info.description = "Time activity is held after the last trigger.";
+    info.units = "ms";
+    info.type = SoapySDR::ArgInfo::INT;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "activity";
+    info.value = "";
+    info.name = "Activity status";
+    info.description = "Detector decision, block energy, noise floor, spectral flatness, and share of active blocks.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "sweep";
+    info.value = "";
+    info.name = "Spectrum sweep";
+    info.description = "Write 'start:stop:bin[:averages]' in Hz to sweep a range while not streaming, read the stitched spectrum in dBFS.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "iqClients";
+    info.value = "";
+    info.name = "IQ server clients";
+    info.description = "Throughput and drops of each client connected to the IQ server, one per line.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "buffers";
+    info.value = "";
+    info.name = "Stream buffers";
+    info.description = "Stream buffer pool size and usage. 'malahit -b' checks that readStream() does not allocate.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "realtime";
+    info.value = "";
+    info.name = "Real-time status";
+    info.description = "Whether requested scheduling, CPU affinity and memory locking were applied.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
+  {
+    SoapySDR::ArgInfo info;
+    info.key = "metrics";
+    info.value = "";
+    info.name = "Driver metrics";
+    info.description = "Driver statistics as name=value lines, write 'reset' to clear.";
+    info.type = SoapySDR::ArgInfo::STRING;
+    result.push_back(info);
+  }
+
   return(result);
 }
 
@@ -617,26 +1809,145 @@ void MalahitSDR::writeSetting(const std::string &key, const std::string &value)
 
   if(key=="biasT" && !!(switches & SW_BIAST)!=(value=="true"))
   {
+    std::lock_guard <std::mutex> lock(mutex);
     switches = (switches & ~SW_BIAST) | (value=="true"? SW_BIAST : 0);
-    updateRadio();
+    updateRadio(CHANGE_SWITCHES);
   }
 
   if(key=="highZ" && !!(switches & SW_HIGHZ)!=(value=="true"))
   {
+    std::lock_guard <std::mutex> lock(mutex);
     switches = (switches & ~SW_HIGHZ) | (value=="true"? SW_HIGHZ : 0);
-    updateRadio();
+    updateRadio(CHANGE_SWITCHES);
   }
 
   if(key=="lna" && !!(switches & SW_PREAMP)!=(value=="true"))
   {
+    std::lock_guard <std::mutex> lock(mutex);
     switches = (switches & ~SW_PREAMP) | (value=="true"? SW_PREAMP : 0);
-    updateRadio();
+    updateRadio(CHANGE_SWITCHES);
   }
 
   if(key=="attenuator" && (unsigned int)stoi(value)!=attenuator)
   {
+    std::lock_guard <std::mutex> lock(mutex);
     attenuator = std::max(0, std::min(30, stoi(value)));
-    updateRadio();
+    updateRadio(CHANGE_GAIN);
+  }
+
+  if(key=="metrics" && value=="reset")
+    metrics.reset();
+
+  if(key=="settleMode")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    settleMode = value=="drop"? SETTLE_DROP : value=="tag"? SETTLE_TAG : SETTLE_OFF;
+  }
+
+  if(key=="settleMargin")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    settleMargin = std::max(0, stoi(value));
+  }
+
+  if(key=="sweep")
+    runSweep(value);
+
+  if(key=="powerPolicy")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    power.configure(getPowerMode(value), power.getSaveCharge(), power.getSaveVoltage(), power.getCapacity());
+  }
+
+  if(key=="powerSaveCharge")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    power.configure(power.getMode(), stod(value), power.getSaveVoltage(), power.getCapacity());
+  }
+
+  if(key=="powerSaveVoltage")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    power.configure(power.getMode(), power.getSaveCharge(), stod(value), power.getCapacity());
+  }
+
+  if(key=="history")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    configureHistory(std::max(0.0, stod(value)));
+  }
+
+  if(key=="snapshot")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    history.snapshot(value, snapshotPost);
+  }
+
+  if(key=="snapshotPost")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    snapshotPost = std::max(0.0, stod(value));
+  }
+
+  if(key=="signal" && value=="reset")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    signalStats.reset();
+  }
+
+  if(key=="simd")
+    Kernels::select(value);
+
+  if(key=="dsp" && value=="reset")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    for(auto &handle: streams) handle->pipeline.resetStats();
+  }
+
+  if(key=="noiseBlanker")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    unsigned int mode =
+      value=="interpolate"? NoiseBlanker::MODE_INTERPOLATE :
+      value=="blank"? NoiseBlanker::MODE_BLANK : NoiseBlanker::MODE_OFF;
+    blanker.configure(mode, blanker.getThreshold(), blanker.getWidth());
+  }
+
+  if(key=="noiseBlankerThreshold")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    blanker.configure(blanker.getMode(), stod(value), blanker.getWidth());
+  }
+
+  if(key=="noiseBlankerWidth")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    blanker.configure(blanker.getMode(), blanker.getThreshold(), std::max(1, stoi(value)));
+  }
+
+  if(key=="activityMode")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    activityMode = value=="gate"? ACTIVITY_GATE : value=="flag"? ACTIVITY_FLAG : ACTIVITY_OFF;
+    activity.reset();
+  }
+
+  if(key=="activityThreshold")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    activity.configure(stod(value), activity.getFlatness(), activity.getHang(), activity.getDecimation());
+  }
+
+  if(key=="activityFlatness")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    activity.configure(activity.getThreshold(), stod(value), activity.getHang(), activity.getDecimation());
+  }
+
+  if(key=="activityHang")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    activity.configure(activity.getThreshold(), activity.getFlatness(), std::max(0, stoi(value)), activity.getDecimation());
   }
 }
 
@@ -646,8 +1957,126 @@ std::string MalahitSDR::readSetting(const std::string &key) const
   if(key=="highZ")       return std::to_string(!!(switches & SW_HIGHZ));
   if(key=="lna")         return std::to_string(!!(switches & SW_PREAMP));
   if(key=="attenuator")  return std::to_string(attenuator);
-  if(key=="voltage")     return std::to_string(stmDevice.getVbat());
-  if(key=="charger")     return std::to_string(stmDevice.isCharging());
+  if(key=="voltage" || key=="charger")
+  {
+    float voltage;
+    char charger;
+
+    // Fuel gauge status is already at hand, the STM has to be asked
+    if(!gauge.getStatus(&voltage, 0, 0, &charger))
+    {
+      if(!stmDevice) return "0";
+      return key=="voltage"? std::to_string(stmDevice->getVbat()) : std::to_string(stmDevice->isCharging());
+    }
+
+    return key=="voltage"? std::to_string(voltage) : std::to_string(!!charger);
+  }
+
+  if(key=="history")      return history.getStatus();
+  if(key=="snapshot")     return history.isWriting()? "writing" : "idle";
+  if(key=="snapshotPost") return std::to_string(snapshotPost);
+  if(key=="synthetic")
+  {
+    // Generator state changes with every read and retune
+    std::lock_guard <std::mutex> lock(mutex);
+    return synthetic? synthetic->getStatus() : "";
+  }
+
+  if(key=="signal")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    return(signalStats.getStatus());
+  }
+
+  if(key=="telemetry")
+    return("source=" + std::string(gauge.isRunning()? "sw6106" : "stm") +
+      "\npolls=" + std::to_string(gauge.getPolls()) + "\nerrors=" + std::to_string(gauge.getErrors()) + "\n");
+  if(key=="metrics")     return metrics.toString();
+  if(key=="retuneIndex") return std::to_string(retuneIndex);
+  if(key=="settleMode")  return settleMode==SETTLE_DROP? "drop" : settleMode==SETTLE_TAG? "tag" : "off";
+  if(key=="settleMargin") return std::to_string(settleMargin);
+  if(key=="sweep")       return sweepResult;
+  if(key=="buffers")
+  {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "pool=%zu\nused=%zu\nhuge=%s\n",
+      pool.getSize(), pool.getUsed(), pool.isHuge()? "true":"false");
+    return(buf);
+  }
+
+  if(key=="iqClients") return iqServer.getStats();
+
+  if(key=="powerPolicy")
+  {
+    static const char *modeNames[] = { "auto", "normal", "save" };
+    return(modeNames[power.getMode()]);
+  }
+  if(key=="powerSaveCharge")  return std::to_string(power.getSaveCharge());
+  if(key=="powerSaveVoltage") return std::to_string(power.getSaveVoltage());
+  if(key=="power")
+    return(power.getStatus() + "period=" + std::to_string(alsaDevice->getChunkSize()) + "\n");
+
+  if(key=="simd") return Kernels::getStatus();
+
+  if(key=="dsp")
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    std::string result;
+
+    for(unsigned int j=0 ; j<streams.size() ; ++j)
+      result += "stream" + std::to_string(j) + ": " + streams[j]->pipeline.getChain() +
+        (streams[j]->pipeline.isFused()? " (fused)\n" : "\n") + streams[j]->pipeline.getStats();
+
+    return(result);
+  }
+
+  if(key=="noiseBlanker")
+    return blanker.getMode()==NoiseBlanker::MODE_INTERPOLATE? "interpolate" :
+           blanker.getMode()==NoiseBlanker::MODE_BLANK? "blank" : "off";
+  if(key=="noiseBlankerThreshold") return std::to_string(blanker.getThreshold());
+  if(key=="noiseBlankerWidth")     return std::to_string(blanker.getWidth());
+  if(key=="noiseBlankerStatus")
+  {
+    // Capture updates blanker state under the same lock
+    std::lock_guard <std::mutex> lock(mutex);
+    return blanker.getStatus();
+  }
+
+  if(key=="activityMode")
+    return activityMode==ACTIVITY_GATE? "gate" : activityMode==ACTIVITY_FLAG? "flag" : "off";
+  if(key=="activityThreshold") return std::to_string(activity.getThreshold());
+  if(key=="activityFlatness")  return std::to_string(activity.getFlatness());
+  if(key=="activityHang")      return std::to_string(activity.getHang());
+  if(key=="activity")
+  {
+    // Capture updates detector state under the same lock
+    std::lock_guard <std::mutex> lock(mutex);
+    return activity.getStatus();
+  }
+
+  if(key=="realtime")
+    return "capture: " + captureRT.getStatus() + "\n"
+         + "control: " + controlRT.getStatus() + "\n"
+         + "mlock: " + lockStatus + "\n";
+
+  if(key=="settleTimes")
+  {
+    static const char *names[CHANGE_COUNT] = { "frequency", "gain", "rate", "switches" };
+    std::string result;
+    char buf[128];
+
+    for(unsigned int j=0 ; j<CHANGE_COUNT ; ++j)
+    {
+      snprintf(buf, sizeof(buf), "%s_avg_us=%llu\n%s_max_us=%llu\n%s_count=%llu\n",
+        names[j], settleCount[j]? settleTotal[j] / settleCount[j] : 0,
+        names[j], settleMax[j],
+        names[j], settleCount[j]
+      );
+      result += buf;
+    }
+
+    return result;
+  }
 
   return "";
 }
@@ -655,13 +2084,130 @@ std::string MalahitSDR::readSetting(const std::string &key) const
 /***********************************************************************
  * Find available devices
  **********************************************************************/
+static const char *wiringKeys[] = { "spi", "gpio", "rst", "busy", "alsa" };
+  // Arguments describing how a unit is wired, each may list several
+  // units separated by semicolons, as ALSA names contain commas.
+
+static unsigned int getWiringCount(const SoapySDR::Kwargs &args)
+{
+  unsigned int result = 1;
+
+  for(const char *key: wiringKeys)
+    if(args.count(key))
+      result = std::max(result, (unsigned int)std::count(args.at(key).begin(), args.at(key).end(), ';') + 1);
+
+  return(result);
+}
+
+static std::string getWiring(const SoapySDR::Kwargs &args, const char *key, unsigned int index, const char *defValue)
+{
+  auto j = args.find(key);
+  if(j==args.end()) return(defValue);
+
+  // Take INDEX-th semicolon-separated item, repeating the last one for
+  // lists shorter than others
+  size_t start = 0, end;
+  for(unsigned int n=0 ; ((end = j->second.find(';', start))!=std::string::npos) && (n<index) ; ++n)
+    start = end + 1;
+
+  std::string result = j->second.substr(start, end==std::string::npos? end : end - start);
+  return(result.empty()? defValue : result);
+}
+
+static SoapySDR::KwargsList probeMalahitSDR(const SoapySDR::Kwargs &args)
+{
+  SoapySDR::KwargsList result;
+
+  // Only STM wirings given by arguments, or the default one, are
+  // probed. Other SPI buses may have other devices, and the GPIO lines
+  // of other units are unknown. Several units are given as lists, such
+  // as spi=/dev/spidev0.0;/dev/spidev1.0 rst=17;22 alsa=hw:0,0;hw:1,0
+  for(unsigned int j=0, count=getWiringCount(args) ; j<count ; ++j)
+  {
+    std::string spi  = getWiring(args, "spi", j, STM::DEFAULT_SPI);
+    std::string gpio = getWiring(args, "gpio", j, GPIO::DEFAULT_CHIP);
+    std::string rst  = getWiring(args, "rst", j, "");
+    std::string busy = getWiring(args, "busy", j, "");
+
+    // Units open in this process cannot be probed, they are busy
+    auto open = openUnits.find(spi);
+    if(open!=openUnits.end())
+    {
+      result.push_back(open->second);
+      continue;
+    }
+
+    // Read STM chip ID without resetting the STM, RST stays released
+    STM stm(spi.c_str(), 10000000, gpio.c_str(), rst.empty()? -1 : atoi(rst.c_str()), busy.empty()? -1 : atoi(busy.c_str()));
+    const char *id = stm.isOpen() && stm.isReady()? stm.getId() : 0;
+    if(!id) continue;
+
+    // Nothing ties an ALSA card to an SPI bus, so use the one listed
+    // for this unit by the "alsa" argument, or the default device
+    SoapySDR::Kwargs unit;
+    unit["driver"] = "malahitrr";
+    unit["label"]  = std::string("Malahit-RR ") + id;
+    unit["serial"] = id;
+    unit["spi"]    = spi;
+    unit["gpio"]   = gpio;
+    unit["alsa"]   = getWiring(args, "alsa", j, "default");
+    if(!rst.empty())  unit["rst"]  = rst;
+    if(!busy.empty()) unit["busy"] = busy;
+    result.push_back(unit);
+  }
+
+  return(result);
+}
+
 SoapySDR::KwargsList findMalahitSDR(const SoapySDR::Kwargs &args)
 {
-    (void)args;
-    //locate the device on the system...
-    //return a list of 0, 1, or more argument maps that each identify a device
+  std::lock_guard <std::mutex> lock(unitMutex);
+  SoapySDR::KwargsList result;
+
+  // Shared memory rings are served by another process, do not probe
+  if(args.count("shm"))
+  {
+    SharedRing ring;
+    if(ring.attach(args.at("shm").c_str()) && ring.isAlive())
+    {
+      SoapySDR::Kwargs unit;
+      unit["driver"] = "malahitrr";
+      unit["label"]  = "Malahit-RR (shared '" + args.at("shm") + "')";
+      unit["shm"]    = args.at("shm");
+      result.push_back(unit);
+    }
+    return(result);
+  }
+
+  // Synthetic units need no hardware, do not probe
+  if(args.count("synthetic"))
+  {
+    SoapySDR::Kwargs unit;
+    unit["driver"]    = "malahitrr";
+    unit["label"]     = "Malahit-RR (synthetic)";
+    unit["serial"]    = "synthetic";
+    unit["synthetic"] = args.at("synthetic");
+    result.push_back(unit);
+    return(result);
+  }
 
-    return(SoapySDR::KwargsList());
+  // Probing resets nothing, but takes time, so cache results for 5 seconds
+  std::string key;
+  for(const char *arg: wiringKeys) key += std::string(getArg(args, arg, "")) + "|";
+  unsigned long long now = Metrics::now();
+  if(!probeTime || (now - probeTime > 5000000) || (key!=probeKey))
+  {
+    probeCache = probeMalahitSDR(args);
+    probeTime  = now;
+    probeKey   = key;
+  }
+
+  // Filter units by serial number
+  for(auto &unit: probeCache)
+    if(!args.count("serial") || (args.at("serial")==unit.at("serial")))
+      result.push_back(unit);
+
+  return(result);
 }
 
 /***********************************************************************
@@ -669,10 +2215,27 @@ SoapySDR::KwargsList findMalahitSDR(const SoapySDR::Kwargs &args)
  **********************************************************************/
 SoapySDR::Device *makeMalahitSDR(const SoapySDR::Kwargs &args)
 {
-    (void)args;
+    // Attach to a unit served by another process
+    if(args.count("shm"))
+      return(new MalahitClient(args));
+
+    // If only given a serial number, or several wirings, find the
+    // matching unit and open it with its own wiring
+    if(!args.count("synthetic") && ((args.count("serial") && !args.count("spi")) || (getWiringCount(args)>1)))
+    {
+      SoapySDR::KwargsList units = findMalahitSDR(args);
+      if(units.empty())
+        throw std::runtime_error(std::string("makeMalahitSDR unit '") + getArg(args, "serial", "") + "' not found");
+
+      // Other arguments apply to the unit as given
+      SoapySDR::Kwargs unitArgs = args;
+      for(const char *key: wiringKeys) unitArgs.erase(key);
+      for(auto &arg: units[0]) unitArgs[arg.first] = arg.second;
+      return(new MalahitSDR(unitArgs));
+    }
+
     //create an instance of the device object given the args
-    //here we will translate args into something used in the constructor
-    return(new MalahitSDR());
+    return(new MalahitSDR(args));
 }
 
 /***********************************************************************
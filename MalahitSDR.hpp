@@ -6,7 +6,26 @@
 #include "ALSA.hpp"
 #include "GPIO.hpp"
 #include "STM.hpp"
+#include "Metrics.hpp"
+#include "Sweep.hpp"
+#include "RealTime.hpp"
+#include "BufferPool.hpp"
+#include "IQServer.hpp"
+#include "SharedRing.hpp"
+#include "ActivityDetector.hpp"
+#include "NoiseBlanker.hpp"
+#include "Pipeline.hpp"
+#include "PowerPolicy.hpp"
+#include "SW6106.hpp"
+#include "SignalStats.hpp"
+#include "History.hpp"
+#include "Synthetic.hpp"
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 class MalahitSDR : public SoapySDR::Device
 {
@@ -19,7 +38,31 @@ class MalahitSDR : public SoapySDR::Device
     static const unsigned int LED_1     = 0x0001;
     static const unsigned int LED_2     = 0x0002;
 
-    MalahitSDR();
+    enum Change
+    {
+      CHANGE_NONE = -1,
+      CHANGE_FREQUENCY,
+      CHANGE_GAIN,
+      CHANGE_RATE,
+      CHANGE_SWITCHES,
+      CHANGE_COUNT
+    };
+
+    enum SettleMode
+    {
+      SETTLE_OFF = 0,   // Deliver all samples as they are
+      SETTLE_TAG,       // Flag blocks containing stale samples
+      SETTLE_DROP       // Drop stale samples, flag the rest
+    };
+
+    enum ActivityMode
+    {
+      ACTIVITY_OFF = 0, // No activity detection
+      ACTIVITY_FLAG,    // Flag active blocks (SOAPY_SDR_USER_FLAG2)
+      ACTIVITY_GATE     // Flag active blocks, keep quiet ones off servers
+    };
+
+    MalahitSDR(const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
     ~MalahitSDR();
 
     /*******************************************************************
@@ -71,6 +114,14 @@ class MalahitSDR : public SoapySDR::Device
                    long long &timeNs,
                    const long timeoutUs = 200000);
 
+    /*******************************************************************
+     * Time API
+     ******************************************************************/
+
+    bool hasHardwareTime(const std::string &what = "") const;
+
+    long long getHardwareTime(const std::string &what = "") const;
+
     /*******************************************************************
      * Direct buffer access API
      ******************************************************************/
@@ -190,6 +241,16 @@ class MalahitSDR : public SoapySDR::Device
 
     bool hasDCOffset(const int direction, const size_t channel) const;
 
+    /*******************************************************************
+     * Sensor API
+     ******************************************************************/
+
+    std::vector<std::string> listSensors(void) const;
+
+    SoapySDR::ArgInfo getSensorInfo(const std::string &key) const;
+
+    std::string readSensor(const std::string &key) const;
+
     /*******************************************************************
      * Settings API
      ******************************************************************/
@@ -201,9 +262,16 @@ class MalahitSDR : public SoapySDR::Device
     std::string readSetting(const std::string &key) const;
 
   private:
-    const char *statusPipeName = "/tmp/battery";
-    const char *idPipeName = "/tmp/stm-id";
-    const char *alsaDeviceName = "default";
+    std::string statusPipeName;
+      // File receiving battery status.
+    std::string idPipeName;
+      // File receiving STM chip ID and firmware version.
+    std::string alsaDeviceName;
+      // ALSA capture device name.
+    std::string spiDeviceName;
+      // SPI device connected to the STM.
+    std::string serial;
+      // STM chip ID, used as the unit serial number, or "synthetic".
     const unsigned int minFrequency = 150000;
     const unsigned int maxFrequency = 1766000000;
 
@@ -212,14 +280,25 @@ class MalahitSDR : public SoapySDR::Device
 
     mutable std::mutex mutex;
 
-    ALSA alsaDevice;
+    Metrics metrics;
+      // Driver statistics, must outlive devices below.
+    std::unique_ptr<ALSA> alsaDevice;
       // I2S devices are accessed via ALSA API, encapsulated by this object.
-    STM stmDevice;
-      // Interface to the STM SoC.
+    Synthetic *synthetic = 0;
+      // Same object when generating samples instead of capturing them.
+    std::unique_ptr<STM> stmDevice;
+      // Interface to the STM SoC, none when synthetic.
+    SW6106 gauge;
+      // Direct access to the fuel gauge, when wired to the host I2C bus.
+    std::string stmId;
+    unsigned int stmVersion = 0;
+      // STM chip ID and firmware version, last read.
     size_t statusCount = SIZE_MAX/2;
       // Count for battery status reporting.
     size_t ledCount = 0;
       // Count for LED blinking.
+    PowerPolicy power;
+      // Decides when to save battery power.
     unsigned int sampleRate = 650000;
       // Current sample rate in Hz.
     double curFrequency = 1000000.0;
@@ -235,8 +314,154 @@ class MalahitSDR : public SoapySDR::Device
     unsigned int leds = LED_1;
       // Current LED states.
 
-    bool updateRadio();
-      // Send configuration to the radio chips
+    struct Retune
+    {
+      unsigned long long sample; // Stream position to retune at
+      double frequency;          // New frequency in Hz
+    };
+
+    std::vector<Retune> retunes;
+      // Pending timed retunes, in stream order.
+    unsigned long long sampleCount = 0;
+      // Samples delivered since the stream time base.
+    long long timeBase = 0;
+      // Stream time of sample zero, in nanoseconds.
+    long long retuneIndex = -1;
+      // Stream position where the last timed retune took effect.
+
+    unsigned int settleMode = SETTLE_OFF;
+      // What to do with samples captured before changes settle.
+    unsigned int settleMargin = 0;
+      // Extra settling time after STM is ready, in microseconds.
+    std::atomic<unsigned long long> settleDeadline{0};
+      // Time when the last change settles, in microseconds.
+    unsigned long long staleUntil = 0;
+      // Stream position where stale samples end.
+    unsigned long long settleTotal[CHANGE_COUNT] = { 0 };
+    unsigned long long settleMax[CHANGE_COUNT]   = { 0 };
+    unsigned long long settleCount[CHANGE_COUNT] = { 0 };
+      // Measured settling times by change type, in microseconds.
+    struct StreamHandle
+    {
+      Pipeline pipeline;              // Processing and format conversion
+      unsigned long long block = 0;   // Next block to read
+      unsigned int offset = 0;        // Next sample in that block
+      bool active = false;
+    };
+
+    struct Block
+    {
+      short *data = 0;
+      unsigned int count = 0;         // Samples captured
+      unsigned int rate = 0;          // Sample rate at capture
+      long long timeNs = 0;           // Stream time of the first sample
+      int flags = 0;                  // Stream flags
+    };
+
+    static const unsigned int RING_BLOCKS = 16;
+      // Captured blocks kept for streams reading behind.
+
+    std::vector<std::unique_ptr<StreamHandle>> streams;
+      // Streams set up by the application.
+    Block blocks[RING_BLOCKS];
+      // Ring of captured blocks, shared by all streams.
+    unsigned long long blockCount = 0;
+      // Blocks captured so far.
+
+    SignalStats signalStats;
+      // Levels and clipping of captured blocks.
+    NoiseBlanker blanker;
+      // Removes impulse noise from captured blocks.
+    History history;
+      // Recent samples kept for retroactive snapshots.
+    double historySeconds = 0.0;
+    size_t historyLimit = 256;
+    unsigned int historyFormat = History::FORMAT_CS16;
+      // Requested history duration, memory limit in megabytes, and format.
+    double snapshotPost = 10.0;
+      // Seconds of samples added to a snapshot after it is taken.
+    ActivityDetector activity;
+      // Detects signal activity in captured blocks.
+    unsigned int activityMode = ACTIVITY_OFF;
+      // What to do with detected activity.
+
+    BufferPool pool;
+      // Memory for all stream buffers, allocated on activation.
+    bool hugePages = false;
+      // TRUE: back stream buffers with transparent huge pages.
+    short *scratch = 0;
+      // Buffer receiving dropped samples.
+    unsigned int blockSize = 0;
+      // Samples per block and scratch buffer, as carved by openStream().
+
+    RealTime captureRT;
+      // Scheduling for the thread calling readStream().
+    RealTime controlRT;
+      // Scheduling for driver threads.
+    bool captureApplied = false;
+      // TRUE: capture scheduling applied since stream activation.
+    bool lockBuffers = false;
+      // TRUE: lock sample buffers into RAM.
+    std::string lockStatus = "off";
+      // Result of locking sample buffers.
+
+    IQServer iqServer;
+      // Network server fanning samples out to clients.
+    SharedRing shmRing;
+      // Shared memory ring serving samples to other processes.
+    std::thread iqPump;
+      // Thread capturing for the servers when application does not.
+    std::atomic<bool> iqRunning{false};
+      // TRUE: server capture thread should keep running.
+    bool appStream = false;
+      // TRUE: application has activated a stream.
+    bool pumpStream = false;
+      // TRUE: server capture thread has activated the stream.
+
+    std::unique_ptr<Sweep> sweep;
+      // Sweep engine, created on first use.
+    std::string sweepResult;
+      // Spectrum produced by the last sweep.
+
+    bool updateRadio(Change change = CHANGE_NONE);
+      // Send configuration to the radio chips, or retune the synthetic
+      // signals. Call with mutex held, as capture() does.
+
+    void updateStale(ALSA *device);
+      // Find stream position where stale samples end.
+
+    bool runSweep(const std::string &params);
+      // Sweep "start:stop:bin[:averages]" range and store the spectrum.
+      // Refused while streams or servers are capturing.
+
+    void applyRetunes(ALSA *device, unsigned int lead);
+      // Apply timed retunes due within LEAD samples of capture.
+
+    int openStream(ALSA *device);
+      // Open ALSA device and prepare stream state.
+
+    void updateCapture();
+      // Stop capture once no application streams remain active.
+
+    bool capture();
+      // Capture next block into the ring and publish it to the servers.
+
+    bool serveCommand(unsigned int command, unsigned int param);
+      // Apply rtl_tcp command received by the IQ server. Returns false
+      // for unsupported commands and values that could not be applied.
+
+    bool serveRequest(unsigned int command, unsigned int param);
+      // Apply command requested by a shared memory client.
+
+    void publishState();
+      // Publish radio state to shared memory clients.
+
+    void pumpIQ();
+      // Capture samples for server clients while application does not,
+      // and execute shared memory client requests.
+
+    bool configureHistory(double seconds);
+      // Size history for given duration at the current sample rate.
 
     bool reportBattery(size_t samples);
       // Report SW6106 status.
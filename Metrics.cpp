@@ -0,0 +1,262 @@
+#include "Metrics.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+const char *Metrics::counterNames[COUNTER_COUNT] =
+{
+  "alsa_xruns",
+  "alsa_suspends",
+  "frames_captured",
+  "frames_dropped",
+  "spi_transfers",
+  "spi_errors",
+  "crc_errors",
+  "stm_timeouts",
+  "retunes"
+};
+
+const char *Metrics::timerNames[TIMER_COUNT] =
+{
+  "read_stream",
+  "spi_latency",
+  "stm_wait",
+  "noise_blanker"
+};
+
+Metrics::Metrics(): serverRunning(false), serverSocket(-1), serverRT(0)
+{
+  reset();
+}
+
+unsigned long long Metrics::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+void Metrics::reset()
+{
+  for(unsigned int j=0 ; j<COUNTER_COUNT ; ++j)
+    counters[j].store(0, std::memory_order_relaxed);
+
+  for(unsigned int j=0 ; j<TIMER_COUNT ; ++j)
+  {
+    for(unsigned int i=0 ; i<=BUCKET_COUNT ; ++i)
+      timers[j].buckets[i].store(0, std::memory_order_relaxed);
+    timers[j].count.store(0, std::memory_order_relaxed);
+    timers[j].sum.store(0, std::memory_order_relaxed);
+    timers[j].max.store(0, std::memory_order_relaxed);
+  }
+}
+
+void Metrics::time(Timer timer, unsigned long long usec)
+{
+  Histogram &h = timers[timer];
+  unsigned int j;
+
+  // Bucket J contains values below 2^J microseconds, last bucket is overflow
+  for(j=0 ; (j<BUCKET_COUNT) && (usec>>j) ; ++j);
+
+  h.buckets[j].fetch_add(1, std::memory_order_relaxed);
+  h.count.fetch_add(1, std::memory_order_relaxed);
+  h.sum.fetch_add(usec, std::memory_order_relaxed);
+
+  // Update maximum
+  unsigned long long max = h.max.load(std::memory_order_relaxed);
+  while((usec>max) && !h.max.compare_exchange_weak(max, usec, std::memory_order_relaxed));
+}
+
+std::string Metrics::toString() const
+{
+  std::string result;
+  char buf[256];
+
+  for(unsigned int j=0 ; j<COUNTER_COUNT ; ++j)
+  {
+    snprintf(buf, sizeof(buf), "%s=%llu\n", counterNames[j], get((Counter)j));
+    result += buf;
+  }
+
+  for(unsigned int j=0 ; j<TIMER_COUNT ; ++j)
+  {
+    const Histogram &h = timers[j];
+    unsigned long long count = h.count.load(std::memory_order_relaxed);
+    unsigned long long sum   = h.sum.load(std::memory_order_relaxed);
+    unsigned long long p99   = 0;
+
+    // Find upper bound of the bucket containing 99th percentile
+    if(count)
+    {
+      unsigned long long total = 0;
+      for(unsigned int i=0 ; i<=BUCKET_COUNT ; ++i)
+      {
+        total += h.buckets[i].load(std::memory_order_relaxed);
+        if(total*100 >= count*99) { p99 = 1ULL << i;break; }
+      }
+    }
+
+    snprintf(buf, sizeof(buf), "%s_count=%llu\n%s_avg_us=%llu\n%s_max_us=%llu\n%s_p99_us=%llu\n",
+      timerNames[j], count,
+      timerNames[j], count? sum/count : 0,
+      timerNames[j], h.max.load(std::memory_order_relaxed),
+      timerNames[j], p99
+    );
+    result += buf;
+  }
+
+  return(result);
+}
+
+std::string Metrics::toPrometheus() const
+{
+  std::string result;
+  char buf[256];
+
+  for(unsigned int j=0 ; j<COUNTER_COUNT ; ++j)
+  {
+    snprintf(buf, sizeof(buf),
+      "# TYPE malahit_%s_total counter\nmalahit_%s_total %llu\n",
+      counterNames[j], counterNames[j], get((Counter)j)
+    );
+    result += buf;
+  }
+
+  for(unsigned int j=0 ; j<TIMER_COUNT ; ++j)
+  {
+    const Histogram &h = timers[j];
+    unsigned long long total = 0;
+
+    snprintf(buf, sizeof(buf), "# TYPE malahit_%s_seconds histogram\n", timerNames[j]);
+    result += buf;
+
+    // Prometheus buckets are cumulative
+    for(unsigned int i=0 ; i<BUCKET_COUNT ; ++i)
+    {
+      total += h.buckets[i].load(std::memory_order_relaxed);
+      snprintf(buf, sizeof(buf), "malahit_%s_seconds_bucket{le=\"%g\"} %llu\n",
+        timerNames[j], (1ULL << i) / 1000000.0, total
+      );
+      result += buf;
+    }
+
+    snprintf(buf, sizeof(buf),
+      "malahit_%s_seconds_bucket{le=\"+Inf\"} %llu\n"
+      "malahit_%s_seconds_sum %g\n"
+      "malahit_%s_seconds_count %llu\n",
+      timerNames[j], h.count.load(std::memory_order_relaxed),
+      timerNames[j], h.sum.load(std::memory_order_relaxed) / 1000000.0,
+      timerNames[j], h.count.load(std::memory_order_relaxed)
+    );
+    result += buf;
+  }
+
+  return(result);
+}
+
+bool Metrics::startServer(const char *socketName, const RealTime *rt)
+{
+  struct sockaddr_un addr;
+
+  // Stop current server, if any
+  stopServer();
+
+  if(strlen(socketName) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, "Metrics::startServer(): Socket name '%s' too long!\n", socketName);
+    return(false);
+  }
+
+  serverSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(serverSocket<0)
+  {
+    fprintf(stderr, "Metrics::startServer(): Failed creating socket!\n");
+    return(false);
+  }
+
+  // Remove stale socket left by a previous run
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socketName);
+  unlink(socketName);
+
+  if((bind(serverSocket, (struct sockaddr *)&addr, sizeof(addr))<0) || (listen(serverSocket, 4)<0))
+  {
+    fprintf(stderr, "Metrics::startServer(): Failed listening on '%s'!\n", socketName);
+    ::close(serverSocket);
+    serverSocket = -1;
+    return(false);
+  }
+
+  fprintf(stderr, "Metrics::startServer(): Serving metrics on '%s'.\n", socketName);
+
+  serverSocketName = socketName;
+  serverRT = rt;
+  serverRunning = true;
+  serverThread = std::thread(&Metrics::serve, this);
+  return(true);
+}
+
+void Metrics::stopServer()
+{
+  if(serverThread.joinable())
+  {
+    serverRunning = false;
+    serverThread.join();
+  }
+
+  if(serverSocket>=0)
+  {
+    ::close(serverSocket);
+    unlink(serverSocketName.c_str());
+    serverSocket = -1;
+  }
+}
+
+void Metrics::serve()
+{
+  struct pollfd pfd;
+  char buf[1024];
+
+  if(serverRT) serverRT->apply();
+
+  while(serverRunning)
+  {
+    // Check for stop request every 100ms
+    pfd.fd     = serverSocket;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, 100) <= 0) continue;
+
+    int client = accept4(serverSocket, 0, 0, SOCK_CLOEXEC);
+    if(client<0) continue;
+
+    // Consume HTTP request, if any, without blocking for long
+    pfd.fd = client;
+    if(poll(&pfd, 1, 100) > 0) recv(client, buf, sizeof(buf), MSG_DONTWAIT);
+
+    // Reply with a minimal HTTP response, understood by Prometheus
+    std::string body = toPrometheus();
+    snprintf(buf, sizeof(buf),
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: %zu\r\n\r\n",
+      body.size()
+    );
+
+    std::string reply = buf + body;
+    for(size_t j=0 ; j<reply.size() ; )
+    {
+      ssize_t res = send(client, reply.data() + j, reply.size() - j, MSG_NOSIGNAL);
+      if(res<=0) break;
+      j += res;
+    }
+
+    ::close(client);
+  }
+}
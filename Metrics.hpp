@@ -0,0 +1,96 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "RealTime.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+
+class Metrics
+{
+  public:
+    enum Counter
+    {
+      ALSA_XRUNS = 0,   // ALSA overruns (EPIPE)
+      ALSA_SUSPENDS,    // ALSA suspends (ESTRPIPE)
+      FRAMES_CAPTURED,  // Frames read from ALSA
+      FRAMES_DROPPED,   // Frames requested but not delivered
+      SPI_TRANSFERS,    // SPI transactions with the STM
+      SPI_ERRORS,       // Failed SPI ioctl() calls
+      CRC_ERRORS,       // Received frames with bad CRC
+      STM_TIMEOUTS,     // Timeouts waiting for STM BUSY line
+      RETUNES,          // Radio configuration updates
+      COUNTER_COUNT
+    };
+
+    enum Timer
+    {
+      READ_STREAM = 0,  // readStream() latency
+      SPI_LATENCY,      // STM SPI transaction latency
+      STM_WAIT,         // Time spent waiting for STM BUSY line
+      NOISE_BLANKER,    // Noise blanker time per captured block
+      TIMER_COUNT
+    };
+
+    static const unsigned int BUCKET_COUNT = 24;
+      // Histogram buckets, covering 1us .. 2^23us (~8s).
+
+    Metrics();
+    ~Metrics() { stopServer(); }
+
+    void count(Counter counter, unsigned long long value = 1)
+    { counters[counter].fetch_add(value, std::memory_order_relaxed); }
+      // Increment given counter.
+
+    void time(Timer timer, unsigned long long usec);
+      // Add given duration (in microseconds) to the timer histogram.
+
+    unsigned long long get(Counter counter) const
+    { return(counters[counter].load(std::memory_order_relaxed)); }
+      // Get current counter value.
+
+    void reset();
+      // Reset all counters and histograms.
+
+    std::string toString() const;
+      // Print metrics as "name=value" pairs, one per line.
+
+    std::string toPrometheus() const;
+      // Print metrics in Prometheus text exposition format.
+
+    bool startServer(const char *socketName, const RealTime *rt = 0);
+      // Serve Prometheus metrics on a local Unix socket, optionally
+      // applying given scheduling to the server thread.
+
+    void stopServer();
+      // Stop serving metrics.
+
+    static unsigned long long now();
+      // Get monotonic time in microseconds.
+
+  private:
+    struct Histogram
+    {
+      std::atomic<unsigned long long> buckets[BUCKET_COUNT + 1];
+      std::atomic<unsigned long long> count;
+      std::atomic<unsigned long long> sum;
+      std::atomic<unsigned long long> max;
+    };
+
+    static const char *counterNames[COUNTER_COUNT];
+    static const char *timerNames[TIMER_COUNT];
+
+    std::atomic<unsigned long long> counters[COUNTER_COUNT];
+    Histogram timers[TIMER_COUNT];
+
+    std::thread serverThread;
+    std::atomic<bool> serverRunning;
+    std::string serverSocketName;
+    int serverSocket;
+    const RealTime *serverRT;
+
+    void serve();
+      // Accept connections and send out metrics.
+};
+
+#endif // METRICS_HPP
@@ -0,0 +1,151 @@
+#include "NoiseBlanker.hpp"
+#include "Kernels.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+void NoiseBlanker::configure(unsigned int mode, double threshold, unsigned int width, double tau)
+{
+  this->mode      = std::min(mode, (unsigned int)MODE_INTERPOLATE);
+  this->threshold = std::max(1.0, threshold);
+  this->width     = std::max(1U, width);
+  this->tau       = std::max(0.0001, tau);
+
+  reset();
+}
+
+void NoiseBlanker::reset()
+{
+  average  = 0.0f;
+  hold     = 0;
+  lastI    = 0;
+  lastQ    = 0;
+  pending  = 0;
+  impulses = 0;
+  blanked  = 0;
+  total    = 0;
+}
+
+void NoiseBlanker::fill(short *data, unsigned int count, short i1, short q1)
+{
+  if(mode==MODE_BLANK)
+  {
+    std::fill(data, data + 2 * count, 0);
+    return;
+  }
+
+  // Draw a line from the last good sample to the next one
+  int di = i1 - lastI;
+  int dq = q1 - lastQ;
+  for(unsigned int j=0 ; j<count ; ++j)
+  {
+    data[2 * j]     = lastI + di * (int)(j + 1) / (int)(count + 1);
+    data[2 * j + 1] = lastQ + dq * (int)(j + 1) / (int)(count + 1);
+  }
+}
+
+unsigned int NoiseBlanker::process(short *data, unsigned int samples, unsigned int rate)
+{
+  int mag[SEGMENT];
+  unsigned int result = 0;
+
+  if((mode==MODE_OFF) || !samples) return(0);
+
+  // Average is updated once per segment
+  float alpha = std::min(1.0, SEGMENT / (tau * std::max(1U, rate)));
+
+  for(unsigned int j=0 ; j<samples ; j+=SEGMENT)
+  {
+    unsigned int n = std::min(SEGMENT, samples - j);
+    short *seg = data + 2 * j;
+    int sum = 0, peak = 0;
+
+    // Envelope as |I|+|Q|, by the best kernel for this CPU
+    Kernels::get().envelope(seg, n, mag);
+    for(unsigned int k=0 ; k<n ; ++k)
+    {
+      sum += mag[k];
+      peak = std::max(peak, mag[k]);
+    }
+
+    // Start from the first segment level
+    if(average<=0.0f) average = std::max(1.0f, (float)sum / n);
+
+    int limit = (int)std::min(average * threshold, 1.0e6);
+
+    // Fast path: no impulses here and none in progress
+    if((peak<=limit) && !hold && !pending)
+    {
+      average += ((float)sum / n - average) * alpha;
+      lastI = seg[2 * n - 2];
+      lastQ = seg[2 * n - 1];
+      continue;
+    }
+
+    int goodSum = 0;
+    unsigned int good = 0;
+
+    for(unsigned int k=0 ; k<n ; ++k)
+    {
+      // Impulse starts or extends the blanked run
+      if(mag[k]>limit)
+      {
+        if(!hold) impulses++;
+        hold = width;
+      }
+
+      if(hold)
+      {
+        hold--;
+        pending++;
+        continue;
+      }
+
+      // First good sample after a run closes it
+      if(pending)
+      {
+        fill(data + 2 * (j + k - pending), pending, seg[2 * k], seg[2 * k + 1]);
+        result += pending;
+        pending = 0;
+      }
+
+      lastI = seg[2 * k];
+      lastQ = seg[2 * k + 1];
+      goodSum += mag[k];
+      good++;
+    }
+
+    // Mostly blanked segments mean the level changed, follow it anyway
+    if(good > n / 2)
+      average += ((float)goodSum / good - average) * alpha;
+    else
+      average += ((float)sum / n - average) * alpha;
+  }
+
+  // Runs reaching the end are held at the last good sample
+  if(pending)
+  {
+    fill(data + 2 * (samples - pending), pending, lastI, lastQ);
+    result += pending;
+    pending = 0;
+  }
+
+  blanked += result;
+  total   += samples;
+  return(result);
+}
+
+std::string NoiseBlanker::getStatus() const
+{
+  static const char *modeNames[] = { "off", "blank", "interpolate" };
+  char buf[256];
+
+  snprintf(buf, sizeof(buf),
+    "mode=%s\nthreshold=%.1f\nwidth=%u\nenvelope=%.1f\nimpulses=%llu\nblankedRatio=%.6f\n",
+    modeNames[mode], threshold, width, average, impulses,
+    total? (double)blanked / total : 0.0
+  );
+
+  return(buf);
+}
@@ -0,0 +1,63 @@
+#ifndef NOISEBLANKER_HPP
+#define NOISEBLANKER_HPP
+
+#include <string>
+
+class NoiseBlanker
+{
+  public:
+    enum Mode
+    {
+      MODE_OFF = 0,     // Pass samples unchanged
+      MODE_BLANK,       // Replace impulses with zeros
+      MODE_INTERPOLATE  // Replace impulses with a line between good samples
+    };
+
+    static const unsigned int SEGMENT = 64;
+      // Samples processed per vectorized pass.
+
+    NoiseBlanker() { configure(); }
+
+    void configure(unsigned int mode = MODE_OFF, double threshold = 8.0, unsigned int width = 16, double tau = 0.005);
+      // Blank samples whose envelope exceeds THRESHOLD times the running
+      // average envelope, holding the blank for WIDTH samples after the
+      // impulse. Average envelope follows the signal with time constant
+      // TAU seconds.
+
+    unsigned int process(short *data, unsigned int samples, unsigned int rate);
+      // Blank impulses in CS16 samples, in place. Returns number of
+      // blanked samples.
+
+    void reset();
+      // Forget envelope and statistics.
+
+    bool isEnabled() const { return(mode!=MODE_OFF); }
+      // Return TRUE if blanker modifies samples.
+
+    std::string getStatus() const;
+      // Print blanker state and statistics, one value per line.
+
+    unsigned int getMode() const { return(mode); }
+    double getThreshold() const { return(threshold); }
+    unsigned int getWidth() const { return(width); }
+
+  private:
+    unsigned int mode;
+    double threshold;
+    unsigned int width;
+    double tau;
+
+    float average;
+    unsigned int hold;
+    short lastI, lastQ;
+    unsigned int pending;
+
+    unsigned long long impulses;
+    unsigned long long blanked;
+    unsigned long long total;
+
+    void fill(short *data, unsigned int count, short i1, short q1);
+      // Fill COUNT blanked samples ending before a good (I1,Q1) sample.
+};
+
+#endif // NOISEBLANKER_HPP
@@ -0,0 +1,295 @@
+#include "Pipeline.hpp"
+#include "Kernels.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+static inline unsigned long long nowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static inline short toShort(float v)
+{
+  v *= 32768.0f;
+  return((short)(v>=32767.0f? 32767.0f : v<=-32768.0f? -32768.0f : v));
+}
+
+unsigned int DCBlockStage::process(float *data, unsigned int samples)
+{
+  for(unsigned int j=0 ; j<samples ; ++j) step(data[2 * j], data[2 * j + 1]);
+  return(samples);
+}
+
+void ShiftStage::setRate(unsigned int rate)
+{
+  double phase = -2.0 * M_PI * frequency / rate;
+  di = cos(phase);
+  dq = sin(phase);
+}
+
+unsigned int ShiftStage::process(float *data, unsigned int samples)
+{
+  for(unsigned int j=0 ; j<samples ; ++j) step(data[2 * j], data[2 * j + 1]);
+  return(samples);
+}
+
+void ShiftStage::finish()
+{
+  // Keep phasor magnitude from drifting away from one
+  float mag = sqrtf(pi * pi + pq * pq);
+  pi /= mag;
+  pq /= mag;
+}
+
+unsigned int DecimateStage::process(float *data, unsigned int samples)
+{
+  unsigned int result = 0;
+
+  for(unsigned int j=0 ; j<samples ; ++j)
+  {
+    float i = data[2 * j];
+    float q = data[2 * j + 1];
+    if(step(i, q))
+    {
+      data[2 * result]     = i;
+      data[2 * result + 1] = q;
+      ++result;
+    }
+  }
+
+  return(result);
+}
+
+bool Pipeline::configure(unsigned int output, const SoapySDR::Kwargs &args)
+{
+  static const char *stageOrder[] = { "dc", "shift", "decimate" };
+
+  this->output = output;
+  this->rate   = 0;
+  stages.clear();
+  timing.clear();
+  dc       = 0;
+  shift    = 0;
+  decimate = 0;
+  kernel   = 0;
+
+  auto arg = args.find("dsp");
+  std::string chain = arg!=args.end()? arg->second : "";
+  bool fusible = !args.count("fuse") || (args.at("fuse")!="false");
+  unsigned int order = 0;
+
+  // Parse comma-separated stage list
+  for(size_t j=0 ; j<chain.size() ; )
+  {
+    size_t k = chain.find(',', j);
+    std::string name = chain.substr(j, k==std::string::npos? k : k - j);
+    j = k==std::string::npos? chain.size() : k + 1;
+    if(name.empty()) continue;
+
+    unsigned int index;
+    for(index=0 ; (index<3) && (name!=stageOrder[index]) ; ++index);
+
+    if(index==0)
+      stages.emplace_back(dc = new DCBlockStage());
+    else if(index==1)
+      stages.emplace_back(shift = new ShiftStage(args.count("shift")? atof(args.at("shift").c_str()) : 0.0));
+    else if(index==2)
+      stages.emplace_back(decimate = new DecimateStage(args.count("decimation")? atoi(args.at("decimation").c_str()) : 1));
+    else
+    {
+      fprintf(stderr, "Pipeline::configure(): Unknown stage '%s'!\n", name.c_str());
+      configure(output);
+      return(false);
+    }
+
+    // Fused kernels apply each stage once, in the canonical order
+    fusible = fusible && (index >= order);
+    order = index + 1;
+  }
+
+  if(fusible)
+  {
+    static const Kernel kernels[16] =
+    {
+      &Pipeline::fused<false, false, false, false>, &Pipeline::fused<false, false, false, true>,
+      &Pipeline::fused<false, false, true,  false>, &Pipeline::fused<false, false, true,  true>,
+      &Pipeline::fused<false, true,  false, false>, &Pipeline::fused<false, true,  false, true>,
+      &Pipeline::fused<false, true,  true,  false>, &Pipeline::fused<false, true,  true,  true>,
+      &Pipeline::fused<true,  false, false, false>, &Pipeline::fused<true,  false, false, true>,
+      &Pipeline::fused<true,  false, true,  false>, &Pipeline::fused<true,  false, true,  true>,
+      &Pipeline::fused<true,  true,  false, false>, &Pipeline::fused<true,  true,  false, true>,
+      &Pipeline::fused<true,  true,  true,  false>, &Pipeline::fused<true,  true,  true,  true>
+    };
+
+    kernel = kernels[(dc? 8 : 0) + (shift? 4 : 0) + (decimate? 2 : 0) + (output==OUTPUT_CF32? 1 : 0)];
+    timing.resize(1);
+    timing[0].name = "fused(" + getChain() + ")";
+  }
+  else
+  {
+    // Input conversion, stages, output conversion
+    timing.resize(stages.size() + 2);
+    timing[0].name = "cs16";
+    for(unsigned int j=0 ; j<stages.size() ; ++j) timing[j + 1].name = stages[j]->getName();
+    timing.back().name = output==OUTPUT_CF32? "cf32" : "cs16";
+  }
+
+  return(true);
+}
+
+void Pipeline::prepare(unsigned int samples)
+{
+  if(!kernel) work.resize(2 * samples);
+}
+
+unsigned int Pipeline::getInputLimit(unsigned int outSamples) const
+{
+  // Decimator may already hold part of the next output
+  if(!decimate) return(outSamples);
+  return(outSamples * decimate->getFactor() - decimate->getPending());
+}
+
+std::string Pipeline::getChain() const
+{
+  std::string result = "cs16";
+  for(auto &stage: stages) result = result + "," + stage->getName();
+  return(result + (output==OUTPUT_CF32? ",cf32" : ",cs16"));
+}
+
+std::string Pipeline::getStats() const
+{
+  std::string result;
+  char buf[256];
+
+  for(auto &t: timing)
+  {
+    snprintf(buf, sizeof(buf), "%s: %.2fns/sample, %llu samples\n",
+      t.name.c_str(), t.samples? (double)t.ns / t.samples : 0.0, t.samples
+    );
+    result += buf;
+  }
+
+  return(result);
+}
+
+void Pipeline::resetStats()
+{
+  for(auto &t: timing) t.ns = t.samples = 0;
+}
+
+unsigned int Pipeline::process(const short *in, void *out, unsigned int samples, unsigned int rate)
+{
+  // Stages depending on sample rate start over when it changes
+  if(rate!=this->rate)
+  {
+    for(auto &stage: stages) { stage->setRate(rate);stage->reset(); }
+    this->rate = rate;
+  }
+
+  // Plain CS16 output needs no conversion
+  if(stages.empty() && (output==OUTPUT_CS16))
+  {
+    memcpy(out, in, samples * 2 * sizeof(short));
+    return(samples);
+  }
+
+  if(!kernel) return(staged(in, out, samples));
+
+  unsigned long long start = nowNs();
+  unsigned int result = samples;
+
+  // Plain CF32 output is a single conversion, done by the best kernel
+  // for this CPU
+  if(stages.empty())
+    Kernels::get().toFloat(in, (float *)out, 2 * samples);
+  else
+    result = (this->*kernel)(in, out, samples);
+  timing[0].ns += nowNs() - start;
+  timing[0].samples += samples;
+  return(result);
+}
+
+template<bool DC, bool SHIFT, bool DECIMATE, bool FLOAT>
+unsigned int Pipeline::fused(const short *in, void *out, unsigned int samples)
+{
+  float *outF = (float *)out;
+  short *outS = (short *)out;
+  unsigned int result = 0;
+
+  // Each sample goes through all stages while still in registers
+  for(unsigned int j=0 ; j<samples ; ++j)
+  {
+    float i = in[2 * j] / 32768.0f;
+    float q = in[2 * j + 1] / 32768.0f;
+
+    if(DC) dc->step(i, q);
+    if(SHIFT) shift->step(i, q);
+    if(DECIMATE && !decimate->step(i, q)) continue;
+
+    if(FLOAT)
+    {
+      outF[2 * result]     = i;
+      outF[2 * result + 1] = q;
+    }
+    else
+    {
+      outS[2 * result]     = toShort(i);
+      outS[2 * result + 1] = toShort(q);
+    }
+
+    ++result;
+  }
+
+  for(auto &stage: stages) stage->finish();
+  return(result);
+}
+
+unsigned int Pipeline::staged(const short *in, void *out, unsigned int samples)
+{
+  unsigned int result = 0;
+  unsigned int size = work.size() / 2;
+
+  if(!size) return(0);
+
+  // Process in pieces fitting the work buffer
+  for(unsigned int j=0 ; j<samples ; j+=size)
+  {
+    unsigned int n = std::min(size, samples - j);
+    unsigned long long t0 = nowNs(), t1;
+    unsigned int t = 0;
+
+    Kernels::get().toFloat(in + 2 * j, work.data(), 2 * n);
+    t1 = nowNs();
+    timing[t].ns += t1 - t0;
+    timing[t++].samples += n;
+
+    for(auto &stage: stages)
+    {
+      unsigned int count = n;
+      t0 = t1;
+      n  = stage->process(work.data(), n);
+      stage->finish();
+      t1 = nowNs();
+      timing[t].ns += t1 - t0;
+      timing[t++].samples += count;
+    }
+
+    if(output==OUTPUT_CF32)
+      memcpy((float *)out + 2 * result, work.data(), n * 2 * sizeof(float));
+    else
+      Kernels::get().toShort(work.data(), (short *)out + 2 * result, 2 * n);
+
+    timing[t].ns += nowNs() - t1;
+    timing[t].samples += n;
+    result += n;
+  }
+
+  return(result);
+}
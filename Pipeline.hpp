@@ -0,0 +1,194 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <SoapySDR/Types.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+class DSPStage
+{
+  public:
+    virtual ~DSPStage() {}
+
+    virtual const char *getName() const = 0;
+      // Get stage name, as used in the "dsp" stream argument.
+
+    virtual void setRate(unsigned int rate) {}
+      // Adapt to a new input sample rate.
+
+    virtual void reset() {}
+      // Clear filter state.
+
+    virtual unsigned int process(float *data, unsigned int samples) = 0;
+      // Process interleaved complex samples in place. Returns number of
+      // output samples, fewer than SAMPLES for decimating stages.
+
+    virtual void finish() {}
+      // Called after each block, by fused kernels too.
+};
+
+class DCBlockStage: public DSPStage
+{
+  public:
+    static constexpr float CUTOFF = 20.0f;
+      // DC blocker cutoff, in Hz.
+
+    const char *getName() const { return("dc"); }
+    void setRate(unsigned int rate) { pole = 1.0f - 6.2831853f * CUTOFF / rate; }
+    void reset() { xi = xq = yi = yq = 0.0f; }
+    unsigned int process(float *data, unsigned int samples);
+
+    inline void step(float &i, float &q)
+    {
+      yi = i - xi + pole * yi; xi = i; i = yi;
+      yq = q - xq + pole * yq; xq = q; q = yq;
+    }
+      // Single pole DC blocker.
+
+  private:
+    float pole = 0.9999f;
+    float xi = 0.0f, xq = 0.0f, yi = 0.0f, yq = 0.0f;
+};
+
+class ShiftStage: public DSPStage
+{
+  public:
+    ShiftStage(double frequency = 0.0): frequency(frequency) {}
+
+    const char *getName() const { return("shift"); }
+    void setRate(unsigned int rate);
+    void reset() { pi = 1.0f; pq = 0.0f; }
+    unsigned int process(float *data, unsigned int samples);
+    void finish();
+
+    inline void step(float &i, float &q)
+    {
+      float ri = i * pi - q * pq;
+      float rq = i * pq + q * pi;
+      float ni = pi * di - pq * dq;
+      pq = pi * dq + pq * di;
+      pi = ni;
+      i  = ri;
+      q  = rq;
+    }
+      // Multiply by the NCO phasor, then advance it.
+
+  private:
+    double frequency;
+    float pi = 1.0f, pq = 0.0f;   // Current phasor
+    float di = 1.0f, dq = 0.0f;   // Phasor increment per sample
+};
+
+class DecimateStage: public DSPStage
+{
+  public:
+    DecimateStage(unsigned int factor = 1): factor(factor? factor : 1) {}
+
+    const char *getName() const { return("decimate"); }
+    void reset() { ai = aq = 0.0f; count = 0; }
+    unsigned int process(float *data, unsigned int samples);
+
+    unsigned int getFactor() const { return(factor); }
+      // Get decimation factor.
+
+    unsigned int getPending() const { return(count); }
+      // Get samples accumulated towards the next output.
+
+    inline bool step(float &i, float &q)
+    {
+      ai += i;
+      aq += q;
+      if(++count < factor) return(false);
+      i = ai * scale; ai = 0.0f;
+      q = aq * scale; aq = 0.0f;
+      count = 0;
+      return(true);
+    }
+      // Average FACTOR samples, return TRUE when an output is ready.
+
+  private:
+    unsigned int factor;
+    float scale = 1.0f / factor;
+    float ai = 0.0f, aq = 0.0f;
+    unsigned int count = 0;
+};
+
+class Pipeline
+{
+  public:
+    enum Output
+    {
+      OUTPUT_CS16 = 0,
+      OUTPUT_CF32
+    };
+
+    Pipeline() { configure(OUTPUT_CS16); }
+
+    bool configure(unsigned int output, const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+      // Build stage chain from stream arguments:
+      //   dsp=STAGE[,STAGE...]  - stages in order: dc, shift, decimate
+      //   shift=HZ              - frequency shift for the shift stage
+      //   decimation=N          - factor for the decimate stage
+      //   fuse=false            - run stages one by one, never fused
+      // Chains following the dc, shift, decimate order are fused into a
+      // single pass over the data.
+
+    void prepare(unsigned int samples);
+      // Allocate buffers for blocks up to SAMPLES long, so that process()
+      // never allocates.
+
+    unsigned int process(const short *in, void *out, unsigned int samples, unsigned int rate);
+      // Run CS16 input through the chain, writing OUT in the configured
+      // format. Returns number of output samples.
+
+    unsigned int getInputLimit(unsigned int outSamples) const;
+      // Get largest input that yields no more than OUTSAMPLES outputs.
+
+    unsigned int getPending() const { return(decimate? decimate->getPending() : 0); }
+      // Get input samples accumulated towards the next output.
+
+    bool isFused() const { return(kernel!=0); }
+      // Return TRUE if the chain runs as a single fused kernel.
+
+    std::string getChain() const;
+      // Get chain description, such as "cs16,dc,decimate,cf32".
+
+    std::string getStats() const;
+      // Print time spent per stage, one stage per line.
+
+    void resetStats();
+      // Clear timing statistics.
+
+  private:
+    typedef unsigned int (Pipeline::*Kernel)(const short *, void *, unsigned int);
+
+    struct Timing
+    {
+      std::string name;
+      unsigned long long ns = 0;
+      unsigned long long samples = 0;
+    };
+
+    unsigned int output;
+    unsigned int rate;
+    std::vector<std::unique_ptr<DSPStage>> stages;
+    DCBlockStage *dc;
+    ShiftStage *shift;
+    DecimateStage *decimate;
+    Kernel kernel;
+      // Fused kernel for the chain, 0 to run stages one by one.
+    std::vector<float> work;
+      // Buffer for running stages one by one.
+    std::vector<Timing> timing;
+      // Time spent per stage, or in the fused kernel.
+
+    template<bool DC, bool SHIFT, bool DECIMATE, bool FLOAT>
+    unsigned int fused(const short *in, void *out, unsigned int samples);
+      // Fused kernel making one pass over the data.
+
+    unsigned int staged(const short *in, void *out, unsigned int samples);
+      // Run conversions and stages one by one, timing each.
+};
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,96 @@
+#include "PowerPolicy.hpp"
+#include "Metrics.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <sys/resource.h>
+
+void PowerPolicy::configure(unsigned int mode, double saveCharge, double saveVoltage, double capacity)
+{
+  this->mode        = mode>POLICY_SAVE? (unsigned int)POLICY_AUTO : mode;
+  this->saveCharge  = saveCharge;
+  this->saveVoltage = saveVoltage;
+  this->capacity    = capacity;
+
+  // Forced modes apply at once, automatic one at the next update
+  if(this->mode!=POLICY_AUTO) saving = this->mode==POLICY_SAVE;
+}
+
+void PowerPolicy::reset()
+{
+  saving          = mode==POLICY_SAVE;
+  voltage         = 0.0f;
+  current         = 0.0f;
+  charge          = -1;
+  charger         = true;
+  lastTime        = 0;
+  lastSwitches    = 0;
+  wakeups         = 0.0;
+  dischargeTime   = 0;
+  dischargeCharge = 0;
+  runtime         = -1.0;
+}
+
+bool PowerPolicy::update(float voltage, float current, int charge, bool charger)
+{
+  unsigned long long now = Metrics::now();
+  struct rusage usage;
+  bool wasSaving = saving;
+
+  this->voltage = voltage;
+  this->current = current;
+  this->charge  = charge;
+  this->charger = charger;
+
+  // Every context switch of a driver thread is a CPU wakeup
+  if(!getrusage(RUSAGE_SELF, &usage))
+  {
+    unsigned long long switches = usage.ru_nvcsw + usage.ru_nivcsw;
+    if(lastTime && (now>lastTime))
+      wakeups = (switches - lastSwitches) * 1000000.0 / (now - lastTime);
+    lastSwitches = switches;
+  }
+
+  lastTime = now;
+
+  // Track charge drop since discharge began
+  if(charger) dischargeTime = 0;
+  else if(!dischargeTime)
+  {
+    dischargeTime   = now;
+    dischargeCharge = charge;
+  }
+
+  // Estimate runtime from capacity and current, or from charge drop rate
+  runtime = -1.0;
+  if(!charger && (capacity>0.0) && (fabs(current)>0.001))
+    runtime = charge / 100.0 * capacity / 1000.0 / fabs(current);
+  else if(!charger && dischargeTime && (now>dischargeTime) && (dischargeCharge>charge))
+    runtime = charge * ((now - dischargeTime) / 3600000000.0) / (dischargeCharge - charge);
+
+  // Enter power saving below thresholds, leave it with some hysteresis
+  if(mode!=POLICY_AUTO)
+    saving = mode==POLICY_SAVE;
+  else if(charger)
+    saving = false;
+  else if((charge < saveCharge) || (voltage < saveVoltage))
+    saving = true;
+  else if((charge >= saveCharge + 5.0) && (voltage >= saveVoltage + 0.1))
+    saving = false;
+
+  return(saving!=wasSaving);
+}
+
+std::string PowerPolicy::getStatus() const
+{
+  static const char *modeNames[] = { "auto", "normal", "save" };
+  char buf[256];
+
+  snprintf(buf, sizeof(buf),
+    "mode=%s\nsaving=%s\nvoltage=%.2fV\ncurrent=%.2fA\ncharge=%d%%\ncharger=%s\nwakeups=%.1f/s\nruntime=%.1fh\n",
+    modeNames[mode], saving? "true":"false", voltage, current, charge,
+    charger? "true":"false", wakeups, runtime
+  );
+
+  return(buf);
+}
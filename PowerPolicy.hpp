@@ -0,0 +1,77 @@
+#ifndef POWERPOLICY_HPP
+#define POWERPOLICY_HPP
+
+#include <string>
+
+class PowerPolicy
+{
+  public:
+    enum Mode
+    {
+      POLICY_AUTO = 0,  // Save power on battery below thresholds
+      POLICY_NORMAL,    // Never save power
+      POLICY_SAVE       // Always save power
+    };
+
+    static const unsigned int PERIOD_SCALE = 4;
+      // ALSA period multiplier when saving power.
+
+    static const unsigned int STATUS_SCALE = 6;
+      // Battery status and LED interval multiplier when saving power.
+
+    PowerPolicy() { configure();reset(); }
+
+    void configure(unsigned int mode = POLICY_AUTO, double saveCharge = 30.0, double saveVoltage = 3.5, double capacity = 0.0);
+      // In POLICY_AUTO mode, save power when discharging with charge below
+      // SAVECHARGE percent or voltage below SAVEVOLTAGE. Runtime is
+      // estimated from battery CAPACITY (mAh) and current, or from charge
+      // drop over time when CAPACITY is 0.
+
+    void reset();
+      // Forget battery history and measurements.
+
+    bool update(float voltage, float current, int charge, bool charger);
+      // Update with fresh battery status, return TRUE if power saving
+      // got turned on or off.
+
+    bool isSaving() const { return(saving); }
+      // Return TRUE if power should be saved now.
+
+    unsigned int getPeriodScale() const { return(saving? PERIOD_SCALE : 1); }
+      // Get ALSA period multiplier.
+
+    unsigned int getStatusScale() const { return(saving? STATUS_SCALE : 1); }
+      // Get battery status and LED interval multiplier.
+
+    double getRuntime() const { return(runtime); }
+      // Get estimated runtime in hours, negative if unknown.
+
+    std::string getStatus() const;
+      // Print policy state, battery, wakeups and runtime, one per line.
+
+    unsigned int getMode() const { return(mode); }
+    double getSaveCharge() const { return(saveCharge); }
+    double getSaveVoltage() const { return(saveVoltage); }
+    double getCapacity() const { return(capacity); }
+
+  private:
+    unsigned int mode;
+    double saveCharge;
+    double saveVoltage;
+    double capacity;
+    bool saving;
+
+    float voltage;
+    float current;
+    int charge;
+    bool charger;
+
+    unsigned long long lastTime;      // Last update, in microseconds
+    unsigned long long lastSwitches;  // Context switches at last update
+    double wakeups;                   // Context switches per second
+    unsigned long long dischargeTime; // Time discharge began
+    int dischargeCharge;              // Charge when discharge began
+    double runtime;                   // Estimated runtime in hours
+};
+
+#endif // POWERPOLICY_HPP
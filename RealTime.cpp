@@ -0,0 +1,116 @@
+#include "RealTime.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+bool RealTime::configure(const std::string &policy, int priority, const std::string &cpus)
+{
+  if(policy.empty())       this->policy = -1;
+  else if(policy=="fifo")  this->policy = SCHED_FIFO;
+  else if(policy=="rr")    this->policy = SCHED_RR;
+  else if(policy=="other") this->policy = SCHED_OTHER;
+  else
+  {
+    fprintf(stderr, "RealTime::configure(): Unknown policy '%s'!\n", policy.c_str());
+    return(false);
+  }
+
+  this->priority = priority;
+  this->cpus     = cpus;
+  return(true);
+}
+
+bool RealTime::apply() const
+{
+  bool result = true;
+
+  if(policy>=0)
+  {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = policy==SCHED_OTHER? 0 : priority;
+
+    bool applied = !pthread_setschedparam(pthread_self(), policy, &param);
+    if(!applied)
+      fprintf(stderr, "RealTime::apply(): Failed setting priority %d, need CAP_SYS_NICE or rtprio limit!\n", priority);
+    policyApplied = applied;
+    result &= applied;
+  }
+
+  if(!cpus.empty())
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    // Parse comma-separated CPU numbers and ranges
+    for(const char *p = cpus.c_str() ; *p ; )
+    {
+      char *end;
+      int from = strtol(p, &end, 10);
+      int to   = *end=='-'? strtol(end+1, &end, 10) : from;
+      if(end==p) break;
+
+      for(int j=from ; (j<=to) && (j<CPU_SETSIZE) ; ++j) CPU_SET(j, &set);
+      if(*end!=',') break;
+      p = end+1;
+    }
+
+    bool applied = !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(!applied)
+      fprintf(stderr, "RealTime::apply(): Failed pinning to CPUs '%s'!\n", cpus.c_str());
+    cpusApplied = applied;
+    result &= applied;
+  }
+
+  return(result);
+}
+
+std::string RealTime::getStatus() const
+{
+  const char *state[] = { "failed", "applied", "pending" };
+  int policyState = policyApplied, cpusState = cpusApplied;
+  std::string result;
+  char buf[128];
+
+  if(policy>=0)
+  {
+    snprintf(buf, sizeof(buf), "policy=%s priority=%d (%s)",
+      policy==SCHED_FIFO? "fifo" : policy==SCHED_RR? "rr" : "other",
+      priority, state[policyState<0? 2 : policyState]
+    );
+    result += buf;
+  }
+
+  if(!cpus.empty())
+  {
+    snprintf(buf, sizeof(buf), "%scpus=%s (%s)", result.empty()? "":" ",
+      cpus.c_str(), state[cpusState<0? 2 : cpusState]
+    );
+    result += buf;
+  }
+
+  return(result.empty()? "default" : result);
+}
+
+bool RealTime::lockMemory(void *data, size_t size)
+{
+  if(!data || !size) return(true);
+
+  // Touch every page so that it gets mapped
+  long page = sysconf(_SC_PAGESIZE);
+  for(size_t j=0 ; j<size ; j+=page)
+    ((volatile char *)data)[j] = ((volatile char *)data)[j];
+
+  if(mlock(data, size)<0)
+  {
+    fprintf(stderr, "RealTime::lockMemory(): Failed locking %zu bytes, need CAP_IPC_LOCK or memlock limit!\n", size);
+    return(false);
+  }
+
+  return(true);
+}
@@ -0,0 +1,39 @@
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <string>
+
+class RealTime
+{
+  public:
+    RealTime() {}
+
+    bool configure(const std::string &policy, int priority, const std::string &cpus);
+      // Set scheduling policy ("fifo", "rr", "other"), priority, and
+      // CPU list ("2", "0,3", "1-3"). Empty values leave things as is.
+
+    bool isConfigured() const { return(policy>=0 || !cpus.empty()); }
+      // Check if anything is going to be applied.
+
+    bool apply() const;
+      // Apply configuration to the calling thread. Safe to call from
+      // several threads at once.
+
+    std::string getStatus() const;
+      // Report configuration and whether it has been applied.
+
+    static bool lockMemory(void *data, size_t size);
+      // Lock memory into RAM, prefaulting all its pages.
+
+  private:
+    int policy = -1;
+    int priority = 0;
+    std::string cpus;
+    mutable std::atomic<int> policyApplied{-1};
+    mutable std::atomic<int> cpusApplied{-1};
+      // Last outcome of apply(): -1 pending, 0 failed, 1 applied.
+};
+
+#endif // REALTIME_HPP
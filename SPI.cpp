@@ -66,8 +66,8 @@ bool SPI::sendrecv(unsigned char *dataTx, unsigned short lenTx, unsigned char *d
   xfer[0].tx_buf   = (unsigned long)dataTx;
   xfer[0].len      = length;
   xfer[1].speed_hz = speed;
-  xfer[1].rx_buf   = (unsigned long)(lenTx? dataTx + length : 0);
-  xfer[1].tx_buf   = (unsigned long)(lenRx? dataRx + length : 0);
+  xfer[1].rx_buf   = (unsigned long)(lenRx? dataRx + length : 0);
+  xfer[1].tx_buf   = (unsigned long)(lenTx? dataTx + length : 0);
   xfer[1].len      = lenTx>lenRx? lenTx : lenRx;
 
   length = (lenTx || lenRx)? 2 : 1;
@@ -1,4 +1,5 @@
 #include "STM.hpp"
+#include "CRC16.hpp"
 
 #include <unistd.h>
 #include <string.h>
@@ -13,8 +14,9 @@ const char *STM::DEFAULT_SPI = "/dev/spidev0.0";
 
 bool STM::reset() const
 {
-  // Hard-reset STM chip
+  // Hard-reset STM chip, LEDs go dark
   gpio.reset();
+  lastLeds = -1;
 
   // Wait for STM to become ready
   return(gpio.waitForSTM());
@@ -57,13 +59,18 @@ void STM::printData(const char *label, const unsigned char *data, unsigned int l
   fprintf(stderr, "================================================================\n");
 }
 
-bool STM::getStatus(float *voltage, float *current, char *charge, char *charger, char *id, unsigned int *version) const
+bool STM::getStatus(float *voltage, float *current, char *charge, char *charger, char *id, unsigned int *version, bool *loader) const
 {
   std::lock_guard <std::mutex> lock(mutex);
   STMState st;
+  bool result = false;
 
-  // Receive status from the STM
-  bool result = recv((unsigned char *)&st, sizeof(st));
+  // Receive status from the STM, retrying on errors
+  for(unsigned int j=0 ; !result && (j<=MAX_RETRIES) ; ++j)
+  {
+    if(j) backoff(j-1);
+    result = recv((unsigned char *)&st, sizeof(st));
+  }
 
 //  printData("STATUS", (const unsigned char *)&st, sizeof(st));
 
@@ -83,6 +90,9 @@ bool STM::getStatus(float *voltage, float *current, char *charge, char *charger,
     if(*version == 0xFFFF) *version = 0x0000;
   }
 
+  // Check if STM is running its loader instead of the firmware
+  if(loader) *loader = !!st.loader;
+
   // Get STM chip ID
   if(id)
   {
@@ -152,24 +162,40 @@ bool STM::sendrecv(unsigned char *dataTx, unsigned int lenTx, unsigned char *dat
   }
 
   // Send and receive data
-  if(!SPI::sendrecv(dataTx, lenTx, dataRx, lenRx)) return(false);
+  unsigned long long start = metrics? Metrics::now() : 0;
+  bool result = SPI::sendrecv(dataTx, lenTx, dataRx, lenRx);
+
+  if(metrics)
+  {
+    metrics->time(Metrics::SPI_LATENCY, Metrics::now() - start);
+    metrics->count(result? Metrics::SPI_TRANSFERS : Metrics::SPI_ERRORS);
+  }
+
+  if(!result) return(false);
 
-#if 1
-  // Check CRC
+  // Check CRC, let the caller retry if it does not match
   if(dataRx)
   {
     unsigned short crc = ((unsigned short)dataRx[lenRx - 2] << 8) + dataRx[lenRx - 1];
-    if(crc != crc16(dataRx, lenRx-2)) {
-fprintf(stderr, "CRC FOUND 0x%04X, COMPUTED 0x%04X, LENGTH %d\n", crc, crc16(dataRx, lenRx-2), lenRx);
-//return(false);
-}
+    unsigned short computed = crc16(dataRx, lenRx-2);
+    if(crc != computed)
+    {
+      if(metrics) metrics->count(Metrics::CRC_ERRORS);
+      fprintf(stderr, "STM::sendrecv(): CRC found 0x%04X, computed 0x%04X, length %d\n", crc, computed, lenRx);
+      return(false);
+    }
   }
-#endif
 
   // Done
   return(true);
 }
 
+void STM::backoff(unsigned int attempt) const
+{
+  // Wait 1ms, 2ms, 4ms, ... before retrying
+  usleep(1000 << attempt);
+}
+
 bool STM::leds(unsigned char state) const
 {
   std::lock_guard <std::mutex> lock(mutex);
@@ -182,10 +208,12 @@ bool STM::leds(unsigned char state) const
   if(!result)
     fprintf(stderr, "STM::leds(): Failed communicating with STM!\n");
 
+  lastLeds = result? state : -1;
+
   return(result);
 }
 
-bool STM::update(unsigned int rate, unsigned int frequency, unsigned int switches, unsigned char attenuator, unsigned char gain)
+bool STM::update(unsigned int rate, unsigned int frequency, unsigned int switches, unsigned char attenuator, unsigned char gain, int leds)
 {
   std::lock_guard <std::mutex> lock(mutex);
   STMControl cmd;
@@ -210,8 +238,20 @@ bool STM::update(unsigned int rate, unsigned int frequency, unsigned int switche
   cmd.rate[0]  = (rate >> 8) & 0xFF;
   cmd.rate[1]  = rate & 0xFF;
 
-  // Send request
+  // Send request, then LEDs only if they changed, each frame waiting
+  // for BUSY to clear
   bool result = send((unsigned char *)&cmd, sizeof(cmd));
+  if(result && (leds>=0) && (leds!=lastLeds))
+  {
+    unsigned char buf[32];
+
+    buf[0] = 'L';
+    buf[1] = leds;
+
+    result = send(buf, sizeof(buf));
+    lastLeds = result? leds : -1;
+  }
+
   if(!result)
     fprintf(stderr, "STM::update(): Failed communicating with STM!\n");
 
@@ -222,14 +262,7 @@ bool STM::update(unsigned int rate, unsigned int frequency, unsigned int switche
 
 unsigned short STM::crc16(const unsigned char *data, unsigned int length) const
 {
-  unsigned short crc;
-  unsigned int i, j;
-
-  for(i = 0, crc = 0xFFFF; i < length; i++)
-    for (j = 0, crc ^= data[i]; j < 8; j++)
-      crc = (crc >> 1) ^ (crc&1? 0xA001 : 0);
-
-  return crc;
+  return(CRC16::compute(data, length));
 }
 
 bool STM::fwWrite(const unsigned char *data, unsigned int addr, unsigned int length) const
@@ -272,11 +305,15 @@ bool STM::fwRead(unsigned char *data, unsigned int addr, unsigned int length) co
   buf[6] = (length >> 8) & 0xFF;
   buf[7] = length & 0xFF;
 
-  // Send command
-  if(!send(buf, sizeof(buf))) return(false);
+  // Send command and receive response, retrying on errors
+  bool result = false;
+  for(unsigned int j=0 ; !result && (j<=MAX_RETRIES) ; ++j)
+  {
+    if(j) backoff(j-1);
+    result = send(buf, sizeof(buf)) && recv(rsp, sizeof(rsp));
+  }
 
-  // Receive response
-  if(!recv(rsp, sizeof(rsp))) return(false);
+  if(!result) return(false);
 
   // Copy read firmware data
   memcpy(data, rsp + 2 + 4 + 2, length);
@@ -302,13 +339,102 @@ bool STM::getFirmware(const char *firmwareFile) const
   return(j==FIRMWARE_SIZE);
 }
 
-bool STM::updateFirmware(const char *firmwareFile, bool force) const
+unsigned int STM::fwWriteDelta(FILE *F, unsigned int *pagesWritten) const
+{
+  unsigned char buf[FIRMWARE_PAGE];
+  unsigned char cur[FIRMWARE_PAGE];
+  unsigned int j, i;
+
+  *pagesWritten = 0;
+
+  for(j=0 ; j<FIRMWARE_SIZE ; j+=sizeof(buf))
+  {
+    if(fread(buf, 1, sizeof(buf), F) != sizeof(buf)) break;
+
+    // Skip pages that already contain correct data
+    if(fwRead(cur, j, sizeof(cur)) && !memcmp(buf, cur, sizeof(buf))) continue;
+
+    fprintf(stderr, "STM::fwWriteDelta(): Writing %ldkB to 0x%X...\n", sizeof(buf)>>10, j);
+
+    // Write page, then verify it, retrying a few times
+    for(i=0 ; i<3 ; ++i)
+      if(fwWrite(buf, j, sizeof(buf)) && fwRead(cur, j, sizeof(cur)) && !memcmp(buf, cur, sizeof(buf)))
+        break;
+
+    if(i>=3)
+    {
+      fprintf(stderr, "STM::fwWriteDelta(): Failed verifying page at 0x%X!\n", j);
+      break;
+    }
+
+    ++*pagesWritten;
+  }
+
+  return(j);
+}
+
+bool STM::verifyFirmware(const char *firmwareFile) const
+{
+  unsigned char buf[FIRMWARE_PAGE];
+  unsigned char cur[FIRMWARE_PAGE];
+  unsigned short crcFile = 0xFFFF;
+  unsigned short crcDevice = 0xFFFF;
+  unsigned int j, bad;
+
+  FILE *F = fopen(firmwareFile, "rb");
+  if(!F)
+  {
+    fprintf(stderr, "STM::verifyFirmware('%s'): Failed opening file!\n", firmwareFile);
+    return(false);
+  }
+
+  for(j=0, bad=0 ; j<FIRMWARE_SIZE ; j+=sizeof(buf))
+  {
+    if(fread(buf, 1, sizeof(buf), F) != sizeof(buf)) break;
+    if(!fwRead(cur, j, sizeof(cur))) break;
+
+    // Compare page checksums
+    unsigned short crc1 = crc16(buf, sizeof(buf));
+    unsigned short crc2 = crc16(cur, sizeof(cur));
+    if(crc1 != crc2)
+    {
+      fprintf(stderr, "STM::verifyFirmware('%s'): Page at 0x%X differs (0x%04X <> 0x%04X)\n", firmwareFile, j, crc2, crc1);
+      ++bad;
+    }
+
+    // Accumulate whole image checksums
+    crcFile   = CRC16::compute(buf, sizeof(buf), crcFile);
+    crcDevice = CRC16::compute(cur, sizeof(cur), crcDevice);
+  }
+
+  fclose(F);
+
+  if(j!=FIRMWARE_SIZE)
+  {
+    fprintf(stderr, "STM::verifyFirmware('%s'): Failed reading firmware (%dkB/%dkB)...\n", firmwareFile, j>>10, FIRMWARE_SIZE>>10);
+    return(false);
+  }
+
+  fprintf(stderr, "STM::verifyFirmware('%s'): %u bad pages, image CRC 0x%04X, file CRC 0x%04X.\n", firmwareFile, bad, crcDevice, crcFile);
+  return(!bad && (crcFile==crcDevice));
+}
+
+unsigned int STM::getFileVersion(const char *firmwareFile)
+{
+  unsigned int version;
+  const char *p;
+
+  p = strrchr(firmwareFile, '/');
+  p = p? p+1 : firmwareFile;
+  return(sscanf(p, "malahit-r1-fw-%u.bin", &version)==1? version : 0);
+}
+
+bool STM::updateFirmware(const char *firmwareFile, bool force, bool delta) const
 {
   // Assume no firmware for now
   unsigned int oldVersion = 0;
   unsigned int newVersion = 0;
   unsigned int j;
-  const char *p;
 
   // Get current firmware version
   oldVersion = getVersion();
@@ -316,9 +442,7 @@ bool STM::updateFirmware(const char *firmwareFile, bool force) const
     fprintf(stderr, "STM::updateFirmware('%s'): Failed obtaining current version!\n", firmwareFile);
 
   // Obtain new firmware version from the filename
-  p = strrchr(firmwareFile, '/');
-  p = p? p+1 : firmwareFile;
-  if(p && (sscanf(p, "malahit-r1-fw-%u.bin", &newVersion)!=1)) newVersion = 0;
+  newVersion = getFileVersion(firmwareFile);
 
   // If updating firmware...
   if((newVersion > oldVersion) || force)
@@ -334,12 +458,22 @@ bool STM::updateFirmware(const char *firmwareFile, bool force) const
       return(false);
     }
 
-    // Write data from file into STM
-    for(j=0 ; j<FIRMWARE_SIZE ; j+=sizeof(buf))
+    if(delta)
+    {
+      // Only write and verify pages that differ from the file
+      unsigned int pages;
+      j = fwWriteDelta(F, &pages);
+      fprintf(stderr, "STM::updateFirmware('%s'): Wrote %u of %u pages.\n", firmwareFile, pages, FIRMWARE_SIZE / FIRMWARE_PAGE);
+    }
+    else
     {
-      fprintf(stderr, "STM::updateFirmware('%s'): Writing %ldkB to 0x%X...\n", firmwareFile, sizeof(buf)>>10, j);
-      if(fread(buf, 1, sizeof(buf), F) != sizeof(buf)) break;
-      if(!fwWrite(buf, j, sizeof(buf))) break;
+      // Write data from file into STM
+      for(j=0 ; j<FIRMWARE_SIZE ; j+=sizeof(buf))
+      {
+        fprintf(stderr, "STM::updateFirmware('%s'): Writing %ldkB to 0x%X...\n", firmwareFile, sizeof(buf)>>10, j);
+        if(fread(buf, 1, sizeof(buf), F) != sizeof(buf)) break;
+        if(!fwWrite(buf, j, sizeof(buf))) break;
+      }
     }
 
     // Done with the file
@@ -3,6 +3,7 @@
 
 #include "SPI.hpp"
 #include "GPIO.hpp"
+#include <stdio.h>
 #include <mutex>
 
 class STM: public SPI
@@ -10,27 +11,42 @@ class STM: public SPI
   public:
     static const unsigned int FIRMWARE_SIZE = 0x200000;
     static const unsigned int FIRMWARE_STEP = 0x800;
+    static const unsigned int FIRMWARE_PAGE = 0x4000;
+    static const unsigned int MAX_RETRIES   = 3;
     static const char *DEFAULT_SPI;
 
-    STM(const char *deviceName = DEFAULT_SPI, unsigned int speed = 10000000)
+    STM(const char *deviceName = DEFAULT_SPI, unsigned int speed = 10000000, const char *chipName = GPIO::DEFAULT_CHIP, int rstLine = -1, int busyLine = -1)
+    : gpio(chipName, rstLine, busyLine)
     { open(deviceName, speed); }
 
     ~STM() { close(); }
 
+    void setMetrics(Metrics *metrics)
+    { this->metrics = metrics; gpio.setMetrics(metrics); }
+      // Collect SPI statistics into given metrics.
+
+    bool isReady() const { return(gpio.isReady()); }
+      // Check if STM is ready, without waiting.
+
+    bool waitReady() const { return(gpio.waitForSTM()); }
+      // Wait until STM is ready.
+
     bool reset() const;
     bool go() const;
 
-    bool update(unsigned int rate, unsigned int frequency, unsigned int switches, unsigned char attenuator = 0, unsigned char gain = 255);
+    bool update(unsigned int rate, unsigned int frequency, unsigned int switches, unsigned char attenuator = 0, unsigned char gain = 255, int leds = -1);
     bool leds(unsigned char state) const;
 
-    bool getStatus(float *voltage = 0, float *current = 0, char *charge = 0, char *charger = 0, char *id = 0, unsigned int *version = 0) const;
+    bool getStatus(float *voltage = 0, float *current = 0, char *charge = 0, char *charger = 0, char *id = 0, unsigned int *version = 0, bool *loader = 0) const;
     float getVbat() const;
     bool isCharging() const;
     const char *getId();
     unsigned int getVersion() const;
 
-    bool updateFirmware(const char *firmwareFile, bool force = false) const;
+    bool updateFirmware(const char *firmwareFile, bool force = false, bool delta = false) const;
+    static unsigned int getFileVersion(const char *firmwareFile);
     bool getFirmware(const char *firmwareFile) const;
+    bool verifyFirmware(const char *firmwareFile) const;
 
   private:
     typedef struct
@@ -60,7 +76,10 @@ class STM: public SPI
     } STMControl;
 
     GPIO gpio;
+    Metrics *metrics = 0;
     char id[32];
+    mutable int lastLeds = -1;
+      // LED state last sent, -1 if unknown.
 
     mutable std::mutex mutex;
 
@@ -68,10 +87,12 @@ class STM: public SPI
     bool recv(unsigned char *data, unsigned int length) const;
     bool sendrecv(unsigned char *dataTx, unsigned char *dataRx, unsigned int length) const;
     bool sendrecv(unsigned char *dataTx, unsigned int lenTx, unsigned char *dataRx, unsigned int lenRx) const;
+    void backoff(unsigned int attempt) const;
     unsigned short crc16(const unsigned char *data, unsigned int length) const;
     void printData(const char *label, const unsigned char *data, unsigned int length) const;
     bool fwWrite(const unsigned char *data, unsigned int addr, unsigned int length) const;
     bool fwRead(unsigned char *data, unsigned int addr, unsigned int length) const;
+    unsigned int fwWriteDelta(FILE *F, unsigned int *pagesWritten) const;
 };
 
 #endif // STM_HPP
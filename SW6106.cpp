@@ -0,0 +1,121 @@
+#include "SW6106.hpp"
+
+#include <stdio.h>
+#include <chrono>
+
+const char *SW6106::DEFAULT_I2C = "/dev/i2c-1";
+
+bool SW6106::start(const char *deviceName, unsigned char address, unsigned int intervalMs)
+{
+  State st;
+
+  stop();
+
+  // Fuel gauge may not be wired to the host bus on all units
+  if(!open(deviceName, address)) return(false);
+
+  // Identify the chip with reads alone before poll() writes ADC select,
+  // then make sure it answers with a plausible battery voltage
+  unsigned char status, charge;
+  if(!readRegister(REG_STATUS, &status) || !readRegister(REG_CHARGE, &charge) || (charge>100)
+  || !poll(&st) || (st.voltage<2.5f) || (st.voltage>4.5f))
+  {
+    fprintf(stderr, "SW6106::start(): No fuel gauge at %s:0x%02X\n", deviceName, address);
+    close();
+    return(false);
+  }
+
+  fprintf(stderr, "SW6106::start(): Reading fuel gauge at %s:0x%02X, %.2fV %d%%\n", deviceName, address, st.voltage, st.charge);
+
+  state    = st;
+  interval = intervalMs;
+  running  = true;
+  thread   = std::thread(&SW6106::run, this);
+  return(true);
+}
+
+void SW6106::stop()
+{
+  if(thread.joinable())
+  {
+    {
+      std::lock_guard <std::mutex> lock(mutex);
+      running = false;
+    }
+
+    cond.notify_all();
+    thread.join();
+  }
+
+  running = false;
+  close();
+}
+
+bool SW6106::getStatus(float *voltage, float *current, char *charge, char *charger) const
+{
+  std::lock_guard <std::mutex> lock(mutex);
+
+  if(!state.valid) return(false);
+
+  if(voltage) *voltage = state.voltage;
+  if(current) *current = state.current;
+  if(charge)  *charge  = state.charge;
+  if(charger) *charger = state.charger? 'C' : '\0';
+  return(true);
+}
+
+bool SW6106::readRegister(unsigned char reg, unsigned char *value) const
+{
+  return(send(&reg, 1) && recv(value, 1));
+}
+
+bool SW6106::readADC(unsigned char channel, unsigned int *value) const
+{
+  unsigned char sel[2] = { REG_ADC_SEL, channel };
+  unsigned char high, low;
+
+  if(!send(sel, 2) || !readRegister(REG_ADC_HIGH, &high) || !readRegister(REG_ADC_LOW, &low))
+    return(false);
+
+  *value = (high << 4) | (low & 0x0F);
+  return(true);
+}
+
+bool SW6106::poll(State *result) const
+{
+  unsigned char status, charge;
+  unsigned int vbat, ichg, idis;
+
+  if(!readRegister(REG_STATUS, &status)
+  || !readRegister(REG_CHARGE, &charge)
+  || !readADC(ADC_VBAT, &vbat)
+  || !readADC(ADC_ICHARGE, &ichg)
+  || !readADC(ADC_IDISCHARGE, &idis)) return(false);
+
+  // Current is reported as magnitude, like the STM does
+  result->charger = !!(status & 0x01);
+  result->voltage = vbat * 0.0012f;
+  result->current = (result->charger? ichg : idis) * 0.0025f;
+  result->charge  = charge > 100? 100 : charge;
+  result->valid   = true;
+  return(true);
+}
+
+void SW6106::run()
+{
+  std::unique_lock <std::mutex> lock(mutex);
+
+  while(running)
+  {
+    // Poll without holding the lock, readers only see complete states
+    lock.unlock();
+    State st;
+    bool ok = poll(&st);
+    lock.lock();
+
+    polls++;
+    if(ok) state = st; else errors++;
+
+    cond.wait_for(lock, std::chrono::milliseconds(interval), [this] { return(!running); });
+  }
+}
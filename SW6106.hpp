@@ -0,0 +1,87 @@
+#ifndef SW6106_HPP
+#define SW6106_HPP
+
+#include "I2C.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class SW6106: public I2C
+{
+  public:
+    static const char *DEFAULT_I2C;
+    static const unsigned char DEFAULT_ADDRESS = 0x3C;
+    static const unsigned int POLL_INTERVAL    = 2000;
+      // Default bus, address, and polling interval in milliseconds.
+
+    SW6106() {}
+    ~SW6106() { stop(); }
+
+    bool start(const char *deviceName = DEFAULT_I2C, unsigned char address = DEFAULT_ADDRESS, unsigned int intervalMs = POLL_INTERVAL);
+      // Open fuel gauge on given I2C bus and, if it responds with sane
+      // values, start polling it from a background thread.
+
+    void stop();
+      // Stop polling and close the device.
+
+    bool isRunning() const { return(running); }
+      // Check if the fuel gauge is being polled.
+
+    bool getStatus(float *voltage = 0, float *current = 0, char *charge = 0, char *charger = 0) const;
+      // Get the last polled battery status, same units as STM::getStatus().
+      // Never touches the bus.
+
+    unsigned long long getPolls() const { return(polls.load(std::memory_order_relaxed)); }
+    unsigned long long getErrors() const { return(errors.load(std::memory_order_relaxed)); }
+      // Get number of polls and failed polls.
+
+  private:
+    enum Register
+    {
+      REG_STATUS   = 0x0D,  // Bit 0: charging, bit 1: discharging
+      REG_ADC_SEL  = 0x13,  // ADC channel select
+      REG_ADC_HIGH = 0x14,  // ADC data, bits 11..4
+      REG_ADC_LOW  = 0x15,  // ADC data, bits 3..0
+      REG_CHARGE   = 0x7E   // Battery charge, percent
+    };
+
+    enum Channel
+    {
+      ADC_VBAT       = 0,   // Battery voltage, 1.2mV/LSB
+      ADC_ICHARGE    = 2,   // Charging current, 2.5mA/LSB
+      ADC_IDISCHARGE = 3    // Discharging current, 2.5mA/LSB
+    };
+
+    struct State
+    {
+      float voltage = 0.0f;
+      float current = 0.0f;
+      char charge   = 0;
+      bool charger  = false;
+      bool valid    = false;
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    unsigned int interval = POLL_INTERVAL;
+    State state;
+    std::atomic<unsigned long long> polls{0};
+    std::atomic<unsigned long long> errors{0};
+
+    bool readRegister(unsigned char reg, unsigned char *value) const;
+      // Read a single register.
+
+    bool readADC(unsigned char channel, unsigned int *value) const;
+      // Select ADC channel and read its 12-bit value.
+
+    bool poll(State *result) const;
+      // Read battery status from the device.
+
+    void run();
+      // Polling thread body.
+};
+
+#endif // SW6106_HPP
@@ -0,0 +1,384 @@
+#include "SharedRing.hpp"
+#include "Metrics.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <algorithm>
+#include <new>
+
+static const uint32_t RING_MAGIC   = 0x4D4C4852; // "RHLM"
+static const uint32_t RING_VERSION = 2;
+
+enum
+{
+  REQ_FREE = 0,     // Slot available
+  REQ_CLAIMED,      // Client filling slot in
+  REQ_PENDING,      // Waiting for the owner
+  REQ_RUNNING,      // Owner executing request
+  REQ_DONE          // Result available to the client
+};
+
+struct SharedRing::Request
+{
+  std::atomic<uint32_t> status;
+  uint32_t command;
+  uint32_t param;
+  uint32_t result;
+};
+
+struct SharedRing::Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;                    // Ring size in samples, power of 2
+  uint32_t dataOffset;              // Data offset from header, in bytes
+  std::atomic<uint64_t> head;       // Samples written so far
+  std::atomic<uint64_t> reserved;   // Samples written or being written
+  std::atomic<uint64_t> heartbeat;  // Last owner activity, monotonic us
+  std::atomic<uint32_t> wake;       // Futex bumped on every write
+  std::atomic<uint32_t> stateSeq;   // Odd while state is being updated
+  State state;
+  Request requests[REQUEST_COUNT];
+};
+
+static long futex(std::atomic<uint32_t> *addr, int op, uint32_t value, const struct timespec *timeout)
+{
+  // Shared futex, works across processes mapping the same memory
+  return(syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), op, value, timeout, 0, 0));
+}
+
+bool SharedRing::map(int fd, size_t size)
+{
+  void *area = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if(area==MAP_FAILED)
+  {
+    fprintf(stderr, "SharedRing::map(): Failed mapping '%s'!\n", shmName.c_str());
+    return(false);
+  }
+
+  header  = (Header *)area;
+  mapSize = size;
+  return(true);
+}
+
+bool SharedRing::create(const char *name, unsigned int size, unsigned int mode)
+{
+  close();
+
+  // Round size up to a power of 2, so that positions wrap cleanly
+  unsigned int samples;
+  for(samples=4096 ; samples<size ; samples<<=1);
+
+  size_t offset = (sizeof(Header) + 4095) & ~4095;
+  size_t total  = offset + samples * 2 * sizeof(short);
+
+  shmName = std::string("/malahit-") + name;
+  int fd = shm_open(shmName.c_str(), O_CREAT|O_RDWR|O_CLOEXEC, mode & 0666);
+  if(fd<0)
+  {
+    fprintf(stderr, "SharedRing::create(): Failed creating '%s'!\n", shmName.c_str());
+    return(false);
+  }
+
+  // Apply permissions regardless of umask, or of a stale ring left behind
+  if(fchmod(fd, mode & 0666)<0)
+  {
+    fprintf(stderr, "SharedRing::create(): Failed setting mode %03o on '%s'!\n", mode & 0666, shmName.c_str());
+    ::close(fd);
+    shm_unlink(shmName.c_str());
+    return(false);
+  }
+
+  // Start from scratch, in case a stale ring has been left behind
+  if((ftruncate(fd, 0)<0) || (ftruncate(fd, total)<0))
+  {
+    fprintf(stderr, "SharedRing::create(): Failed sizing '%s' to %zu bytes!\n", shmName.c_str(), total);
+    ::close(fd);
+    shm_unlink(shmName.c_str());
+    return(false);
+  }
+
+  if(!map(fd, total))
+  {
+    shm_unlink(shmName.c_str());
+    return(false);
+  }
+
+  // Fresh memory is zeroed, fill in the rest
+  new(header) Header();
+  header->size       = samples;
+  header->dataOffset = offset;
+  header->heartbeat  = Metrics::now();
+  header->version    = RING_VERSION;
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic      = RING_MAGIC;
+
+  data  = (short *)((char *)header + offset);
+  owner = true;
+
+  fprintf(stderr, "SharedRing::create(): Serving IQ data in '%s' (%u samples).\n", shmName.c_str(), samples);
+  return(true);
+}
+
+bool SharedRing::attach(const char *name)
+{
+  struct stat st;
+
+  close();
+
+  shmName = std::string("/malahit-") + name;
+  int fd = shm_open(shmName.c_str(), O_RDWR|O_CLOEXEC, 0);
+  if(fd<0)
+  {
+    fprintf(stderr, "SharedRing::attach(): No ring '%s', daemon not running?\n", shmName.c_str());
+    return(false);
+  }
+
+  if((fstat(fd, &st)<0) || ((size_t)st.st_size<sizeof(Header)) || !map(fd, st.st_size))
+  {
+    fprintf(stderr, "SharedRing::attach(): Failed mapping '%s'!\n", shmName.c_str());
+    if(!header) ::close(fd);
+    close();
+    return(false);
+  }
+
+  if((header->magic!=RING_MAGIC) || (header->version!=RING_VERSION)
+  || (header->dataOffset + header->size * 2 * sizeof(short) > mapSize))
+  {
+    fprintf(stderr, "SharedRing::attach(): Ring '%s' is invalid or of another version!\n", shmName.c_str());
+    close();
+    return(false);
+  }
+
+  data = (short *)((char *)header + header->dataOffset);
+  return(true);
+}
+
+void SharedRing::close()
+{
+  if(header) munmap(header, mapSize);
+  if(owner) shm_unlink(shmName.c_str());
+
+  header  = 0;
+  data    = 0;
+  mapSize = 0;
+  owner   = false;
+  dropped = 0;
+}
+
+bool SharedRing::isAlive() const
+{
+  return(header && (Metrics::now() - header->heartbeat.load(std::memory_order_relaxed) < 3000000));
+}
+
+void SharedRing::write(const short *data, unsigned int samples, long long timeNs)
+{
+  if(!header || !owner) return;
+
+  unsigned int size = header->size;
+  uint64_t head = header->head.load(std::memory_order_relaxed);
+
+  // Only keep what fits
+  if(samples>size)
+  {
+    data    += 2 * (samples - size);
+    timeNs  += (long long)((samples - size) * 1000000000.0 / header->state.sampleRate);
+    samples  = size;
+  }
+
+  // Let readers know these samples are about to be overwritten
+  header->reserved.store(head + samples, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  unsigned int offset = head & (size - 1);
+  unsigned int first  = std::min(samples, size - offset);
+  memcpy(this->data + 2 * offset, data, first * 2 * sizeof(short));
+  memcpy(this->data, data + 2 * first, (samples - first) * 2 * sizeof(short));
+
+  // Tie ring position to stream time
+  std::lock_guard <std::mutex> lock(writeMutex);
+  uint32_t seq = header->stateSeq.load(std::memory_order_relaxed);
+  header->stateSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  header->state.markPosition = head;
+  header->state.markTime     = timeNs;
+  header->stateSeq.store(seq + 2, std::memory_order_release);
+
+  // Publish samples and wake up waiting readers
+  header->head.store(head + samples, std::memory_order_release);
+  header->heartbeat.store(Metrics::now(), std::memory_order_relaxed);
+  header->wake.fetch_add(1, std::memory_order_release);
+  futex(&header->wake, FUTEX_WAKE, INT_MAX, 0);
+}
+
+void SharedRing::setState(const State &state)
+{
+  if(!header || !owner) return;
+
+  std::lock_guard <std::mutex> lock(writeMutex);
+  uint32_t seq = header->stateSeq.load(std::memory_order_relaxed);
+  header->stateSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  uint64_t markPosition = header->state.markPosition;
+  int64_t markTime      = header->state.markTime;
+  header->state = state;
+  header->state.markPosition = markPosition;
+  header->state.markTime     = markTime;
+
+  header->stateSeq.store(seq + 2, std::memory_order_release);
+}
+
+unsigned int SharedRing::serve(const Handler &handler)
+{
+  unsigned int count = 0;
+
+  if(!header || !owner) return(0);
+
+  header->heartbeat.store(Metrics::now(), std::memory_order_relaxed);
+
+  // Requests are executed one at a time, in slot order
+  for(unsigned int j=0 ; j<REQUEST_COUNT ; ++j)
+  {
+    Request &req = header->requests[j];
+    uint32_t status = REQ_PENDING;
+
+    if(!req.status.compare_exchange_strong(status, REQ_RUNNING, std::memory_order_acquire)) continue;
+
+    req.result = handler(req.command, req.param);
+    req.status.store(REQ_DONE, std::memory_order_release);
+    ++count;
+  }
+
+  return(count);
+}
+
+unsigned long long SharedRing::getHead() const
+{
+  return(header? header->head.load(std::memory_order_acquire) : 0);
+}
+
+unsigned int SharedRing::read(short *data, unsigned int samples, unsigned long long &position, long long &timeNs, long timeoutUs)
+{
+  if(!header) return(0);
+
+  unsigned int size = header->size;
+  unsigned long long start = Metrics::now();
+
+  for(;;)
+  {
+    uint32_t wake = header->wake.load(std::memory_order_acquire);
+    unsigned long long head = header->head.load(std::memory_order_acquire);
+    unsigned long long limit = header->reserved.load(std::memory_order_acquire);
+
+    // Skip samples that have been or are being overwritten
+    if(limit - position > size)
+    {
+      dropped += limit - position - size;
+      position = limit - size;
+    }
+
+    if(head > position)
+    {
+      unsigned int count  = std::min((unsigned long long)samples, head - position);
+      unsigned int offset = position & (size - 1);
+      unsigned int first  = std::min(count, size - offset);
+      memcpy(data, this->data + 2 * offset, first * 2 * sizeof(short));
+      memcpy(data + 2 * first, this->data, (count - first) * 2 * sizeof(short));
+
+      // If owner started overwriting samples while we copied, try again
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(header->reserved.load(std::memory_order_relaxed) - position > size) continue;
+
+      State state = getState();
+      timeNs = state.markTime + (long long)(((long long)position - (long long)state.markPosition)
+             * 1000000000.0 / std::max(state.sampleRate, 1U));
+
+      position += count;
+      return(count);
+    }
+
+    // Wait for the owner to write more
+    long long left = timeoutUs - (long long)(Metrics::now() - start);
+    if(left<=0) return(0);
+
+    struct timespec ts = { (time_t)(left / 1000000), (long)(left % 1000000) * 1000 };
+    futex(&header->wake, FUTEX_WAIT, wake, &ts);
+  }
+}
+
+SharedRing::State SharedRing::getState() const
+{
+  State result;
+  uint32_t seq;
+
+  memset(&result, 0, sizeof(result));
+  if(!header) return(result);
+
+  // Retry until we get a copy not torn by the owner
+  do
+  {
+    while((seq = header->stateSeq.load(std::memory_order_acquire)) & 1);
+    memcpy(&result, &header->state, sizeof(result));
+    std::atomic_thread_fence(std::memory_order_acquire);
+  }
+  while(seq != header->stateSeq.load(std::memory_order_relaxed));
+
+  return(result);
+}
+
+bool SharedRing::request(unsigned int command, unsigned int param, long timeoutUs)
+{
+  if(!header || !isAlive()) return(false);
+
+  unsigned long long start = Metrics::now();
+
+  for(;;)
+  {
+    // Find a free slot
+    for(unsigned int j=0 ; j<REQUEST_COUNT ; ++j)
+    {
+      Request &req = header->requests[j];
+      uint32_t status = REQ_FREE;
+
+      if(!req.status.compare_exchange_strong(status, REQ_CLAIMED, std::memory_order_acquire)) continue;
+
+      req.command = command;
+      req.param   = param;
+      req.status.store(REQ_PENDING, std::memory_order_release);
+
+      // Wait for the owner to execute it
+      while(req.status.load(std::memory_order_acquire)!=REQ_DONE)
+      {
+        // Withdraw request on timeout, unless owner already took it
+        status = REQ_PENDING;
+        if((Metrics::now() - start > (unsigned long long)timeoutUs)
+        && req.status.compare_exchange_strong(status, REQ_FREE, std::memory_order_relaxed))
+        {
+          fprintf(stderr, "SharedRing::request(): Command 0x%02X timed out!\n", command);
+          return(false);
+        }
+
+        usleep(1000);
+      }
+
+      bool result = req.result;
+      req.status.store(REQ_FREE, std::memory_order_release);
+      return(result);
+    }
+
+    // All slots busy
+    if(Metrics::now() - start > (unsigned long long)timeoutUs) return(false);
+    usleep(1000);
+  }
+}
@@ -0,0 +1,112 @@
+#ifndef SHAREDRING_HPP
+#define SHAREDRING_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+
+class SharedRing
+{
+  public:
+    static const unsigned int DEFAULT_SIZE = 1 << 20;
+      // Default ring size, in CS16 samples (4MB).
+    static const unsigned int REQUEST_COUNT = 16;
+      // Control requests that may be pending at once.
+    static const unsigned int MAX_RATES = 8;
+    static const unsigned int MAX_GAINS = 16;
+
+    struct State
+    {
+      double frequency;             // Center frequency, Hz
+      double gain;                  // Gain, dB
+      double correction;            // Frequency correction, ppm
+      double minFrequency;          // Tuning range, Hz
+      double maxFrequency;
+      unsigned int sampleRate;      // Sample rate, Hz
+      unsigned int rates[MAX_RATES];// Supported rates, 0-terminated
+      unsigned int gainCount;       // Supported gains, dB
+      double gains[MAX_GAINS];
+      uint64_t markPosition;        // Ring position of a sample...
+      int64_t markTime;             // ...and its stream time, ns
+    };
+
+    typedef std::function<bool(unsigned int command, unsigned int param)> Handler;
+      // Called by the owner to apply client requests.
+
+    SharedRing() {}
+    ~SharedRing() { close(); }
+
+    static const unsigned int DEFAULT_MODE = 0660;
+      // Ring access for the owner and its group, clients can send
+      // requests, so others get none.
+
+    bool create(const char *name, unsigned int size = DEFAULT_SIZE, unsigned int mode = DEFAULT_MODE);
+      // Create ring with given name, size and permissions, becoming its
+      // owner.
+
+    bool attach(const char *name);
+      // Attach to a ring created by another process.
+
+    void close();
+      // Detach from the ring, removing it if we are the owner.
+
+    bool isOpen() const { return(!!header); }
+    bool isOwner() const { return(owner); }
+
+    bool isAlive() const;
+      // Check if ring owner has been active recently.
+
+    /*******************************************************************
+     * Owner side
+     ******************************************************************/
+
+    void write(const short *data, unsigned int samples, long long timeNs);
+      // Append CS16 samples, TIMENS being the time of the first one.
+
+    void setState(const State &state);
+      // Publish radio state. Mark fields are left alone.
+
+    unsigned int serve(const Handler &handler);
+      // Execute pending client requests, return their number.
+
+    /*******************************************************************
+     * Client side
+     ******************************************************************/
+
+    unsigned long long getHead() const;
+      // Get ring position past the last written sample.
+
+    unsigned int read(short *data, unsigned int samples, unsigned long long &position, long long &timeNs, long timeoutUs);
+      // Read up to SAMPLES samples starting at POSITION, waiting for up
+      // to TIMEOUTUS for them to arrive. Samples overwritten before they
+      // could be read get skipped, advancing POSITION and dropped count.
+
+    State getState() const;
+      // Get last published radio state.
+
+    bool request(unsigned int command, unsigned int param, long timeoutUs = 1000000);
+      // Ask ring owner to execute a command (IQServer::Command), waiting
+      // for the result.
+
+    unsigned long long getDropped() const { return(dropped); }
+      // Get number of samples skipped by read().
+
+  private:
+    struct Request;
+    struct Header;
+
+    Header *header = 0;
+    short *data = 0;
+    size_t mapSize = 0;
+    bool owner = false;
+    std::string shmName;
+    unsigned long long dropped = 0;
+    std::mutex writeMutex;
+
+    bool map(int fd, size_t size);
+      // Map shared memory object.
+};
+
+#endif // SHAREDRING_HPP
@@ -0,0 +1,100 @@
+#include "SignalStats.hpp"
+#include "Kernels.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+static inline double toDB(double power)
+{
+  return(10.0 * log10(power + 1e-20));
+}
+
+void SignalStats::reset()
+{
+  lastI = lastQ = Channel();
+  blocks       = 0;
+  samples      = 0;
+  totalClipped = 0;
+  std::fill(rmsHistogram, rmsHistogram + BUCKET_COUNT, 0ULL);
+  std::fill(peakHistogram, peakHistogram + BUCKET_COUNT, 0ULL);
+}
+
+unsigned int SignalStats::getBucket(double dbfs)
+{
+  int j = (int)(-dbfs / BUCKET_DB);
+  return(std::min(std::max(j, 0), (int)BUCKET_COUNT - 1));
+}
+
+void SignalStats::process(const short *data, unsigned int count)
+{
+  const unsigned int LANES = Kernels::LANES;
+  float sum[LANES] = { 0.0f };
+  int peak[LANES] = { 0 };
+  int clip[LANES] = { 0 };
+
+  if(!count) return;
+
+  // One pass over the block in lanes of interleaved I/Q, even lanes
+  // being I and odd ones Q, using the best kernel for this CPU
+  Kernels::get().stats(data, count, CLIP_LEVEL, sum, peak, clip);
+
+  double sumI = 0.0, sumQ = 0.0;
+  int peakI = 0, peakQ = 0;
+  unsigned int clipI = 0, clipQ = 0;
+
+  for(unsigned int k=0 ; k<LANES ; k+=2)
+  {
+    sumI += sum[k];
+    sumQ += sum[k + 1];
+    peakI = std::max(peakI, peak[k]);
+    peakQ = std::max(peakQ, peak[k + 1]);
+    clipI += clip[k];
+    clipQ += clip[k + 1];
+  }
+
+  // Levels relative to a full scale sine
+  lastI.rms     = toDB(2.0 * sumI / count / (32768.0 * 32768.0));
+  lastQ.rms     = toDB(2.0 * sumQ / count / (32768.0 * 32768.0));
+  lastI.peak    = toDB((double)peakI * peakI / (32768.0 * 32768.0));
+  lastQ.peak    = toDB((double)peakQ * peakQ / (32768.0 * 32768.0));
+  lastI.clipped = clipI;
+  lastQ.clipped = clipQ;
+
+  blocks++;
+  samples      += count;
+  totalClipped += clipI + clipQ;
+  rmsHistogram[getBucket(std::max(lastI.rms, lastQ.rms))]++;
+  peakHistogram[getBucket(std::max(lastI.peak, lastQ.peak))]++;
+}
+
+std::string SignalStats::getStatus() const
+{
+  std::string result;
+  char buf[256];
+
+  snprintf(buf, sizeof(buf),
+    "rmsI=%.1fdBFS\nrmsQ=%.1fdBFS\npeakI=%.1fdBFS\npeakQ=%.1fdBFS\nclipI=%u\nclipQ=%u\n"
+    "blocks=%llu\nclipped=%llu\nclipRatio=%.6f\n",
+    lastI.rms, lastQ.rms, lastI.peak, lastQ.peak, lastI.clipped, lastQ.clipped,
+    blocks, totalClipped, samples? totalClipped / (2.0 * samples) : 0.0
+  );
+  result = buf;
+
+  // Histograms as counts per bucket, loudest bucket first
+  const unsigned long long *histograms[] = { rmsHistogram, peakHistogram };
+  const char *names[] = { "rmsHistogram", "peakHistogram" };
+
+  for(unsigned int h=0 ; h<2 ; ++h)
+  {
+    result += names[h];
+    for(unsigned int j=0 ; j<BUCKET_COUNT ; ++j)
+    {
+      snprintf(buf, sizeof(buf), "%c%llu", j? ',' : '=', histograms[h][j]);
+      result += buf;
+    }
+    result += "\n";
+  }
+
+  return(result);
+}
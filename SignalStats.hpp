@@ -0,0 +1,55 @@
+#ifndef SIGNALSTATS_HPP
+#define SIGNALSTATS_HPP
+
+#include <string>
+
+class SignalStats
+{
+  public:
+    static const int CLIP_LEVEL = 32767;
+      // Samples at or beyond this magnitude are counted as clipped.
+
+    static const unsigned int BUCKET_COUNT = 16;
+    static const unsigned int BUCKET_DB    = 6;
+      // Level histograms cover 0 down to -96dBFS in 6dB buckets.
+
+    struct Channel
+    {
+      double rms  = 0.0;              // RMS level, dBFS
+      double peak = 0.0;              // Peak level, dBFS
+      unsigned int clipped = 0;       // Clipped samples
+    };
+
+    SignalStats() { reset(); }
+
+    void process(const short *data, unsigned int samples);
+      // Measure a block of CS16 samples in a single pass.
+
+    void reset();
+      // Clear histograms and totals.
+
+    const Channel &getI() const { return(lastI); }
+    const Channel &getQ() const { return(lastQ); }
+      // Get measurements of the last block.
+
+    unsigned long long getClipped() const { return(totalClipped); }
+      // Get clipped samples, in either channel, since reset.
+
+    std::string getStatus() const;
+      // Print last block levels, totals and histograms, one per line.
+
+  private:
+    Channel lastI;
+    Channel lastQ;
+    unsigned long long blocks;
+    unsigned long long samples;
+    unsigned long long totalClipped;
+    unsigned long long rmsHistogram[BUCKET_COUNT];
+    unsigned long long peakHistogram[BUCKET_COUNT];
+      // Blocks by RMS and peak level of the louder channel.
+
+    static unsigned int getBucket(double dbfs);
+      // Get histogram bucket for given level.
+};
+
+#endif // SIGNALSTATS_HPP
@@ -0,0 +1,190 @@
+#include "Sweep.hpp"
+
+#include <stdio.h>
+#include <math.h>
+
+Sweep::Sweep(unsigned int workers, const RealTime *rt): rt(rt)
+{
+  if(!workers) workers = std::max(1U, std::thread::hardware_concurrency());
+
+  // Two more buffers than workers, so capture can run ahead
+  buffers.resize(workers + 2);
+
+  for(unsigned int j=0 ; j<workers ; ++j)
+    this->workers.push_back(std::thread(&Sweep::work, this));
+}
+
+Sweep::~Sweep()
+{
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  cond.notify_all();
+  for(auto &worker: workers) worker.join();
+}
+
+bool Sweep::plan(double startFreq, double stopFreq, double binWidth, unsigned int rate, unsigned int averages, unsigned int align)
+{
+  std::unique_lock <std::mutex> lock(mutex);
+
+  if((startFreq>=stopFreq) || (binWidth<=0.0) || !rate || !averages || !align) return(false);
+
+  // Wait for previous sweep to finish
+  cond.wait(lock, [this] { return(jobs.empty() && !busy); });
+
+  // Choose power-of-two FFT size giving at least requested resolution
+  for(fftSize=64 ; (fftSize<65536) && (rate/(double)fftSize > binWidth) ; fftSize<<=1);
+
+  // Only use the middle 3/4 of the spectrum, edges are filtered
+  this->binWidth  = rate / (double)fftSize;
+  this->usable    = fftSize * 3 / 4;
+  this->averages  = averages;
+  this->startFreq = startFreq;
+  this->stopFreq  = stopFreq;
+  this->stepCount = ceil((stopFreq - startFreq) / (usable * this->binWidth));
+  this->captureSize = (fftSize * averages + align - 1) / align * align;
+
+  spectrum.assign(stepCount * usable, 0.0f);
+
+  // Hann window, normalized so that a full scale tone reads 0dBFS
+  window.resize(fftSize);
+  windowGain = 0.0f;
+  for(unsigned int j=0 ; j<fftSize ; ++j)
+  {
+    window[j] = 0.5f - 0.5f * cos(2.0 * M_PI * j / fftSize);
+    windowGain += window[j] * 32768.0f;
+  }
+
+  // Allocate capture buffers
+  freeBuffers.clear();
+  for(auto &buffer: buffers)
+  {
+    buffer.resize(2 * getCaptureSize());
+    freeBuffers.push_back(buffer.data());
+  }
+
+  return(true);
+}
+
+double Sweep::getStepFrequency(unsigned int step) const
+{
+  // Center of the usable part of the step
+  return(startFreq + (step + 0.5) * usable * binWidth);
+}
+
+short *Sweep::getBuffer()
+{
+  std::unique_lock <std::mutex> lock(mutex);
+  cond.wait(lock, [this] { return(!freeBuffers.empty()); });
+
+  short *result = freeBuffers.back();
+  freeBuffers.pop_back();
+  return(result);
+}
+
+void Sweep::submit(unsigned int step, short *buffer)
+{
+  {
+    std::lock_guard <std::mutex> lock(mutex);
+    jobs.push_back({ step, buffer });
+  }
+
+  cond.notify_all();
+}
+
+void Sweep::work()
+{
+  std::vector<std::complex<float>> data;
+  FFT fft;
+
+  if(rt) rt->apply();
+
+  for(;;)
+  {
+    Job job;
+
+    {
+      std::unique_lock <std::mutex> lock(mutex);
+      cond.wait(lock, [this] { return(stopping || !jobs.empty()); });
+      if(stopping) return;
+
+      job = jobs.front();
+      jobs.pop_front();
+      ++busy;
+    }
+
+    process(fft, data, job);
+
+    {
+      std::lock_guard <std::mutex> lock(mutex);
+      freeBuffers.push_back(job.buffer);
+      --busy;
+    }
+
+    cond.notify_all();
+  }
+}
+
+void Sweep::process(FFT &fft, std::vector<std::complex<float>> &data, const Job &job)
+{
+  std::vector<float> power(fftSize, 0.0f);
+
+  if(fft.getSize()!=fftSize) fft.setSize(fftSize);
+  data.resize(fftSize);
+
+  // Average power over several windowed FFTs
+  for(unsigned int k=0 ; k<averages ; ++k)
+  {
+    const short *src = job.buffer + 2 * k * fftSize;
+
+    for(unsigned int j=0 ; j<fftSize ; ++j)
+      data[j] = std::complex<float>(src[2*j] * window[j], src[2*j+1] * window[j]);
+
+    fft.transform(data.data());
+
+    for(unsigned int j=0 ; j<fftSize ; ++j)
+      power[j] += std::norm(data[j]);
+  }
+
+  // Replace DC spike with its neighbors
+  power[0] = (power[1] + power[fftSize-1]) / 2;
+
+  // Store usable bins in frequency order, FFT output has DC first
+  float *dst = spectrum.data() + job.step * usable;
+  float scale = 1.0f / (averages * windowGain * windowGain);
+
+  for(unsigned int j=0 ; j<usable ; ++j)
+  {
+    unsigned int bin = (j + fftSize - usable/2) % fftSize;
+    dst[j] = 10.0f * log10f(power[bin] * scale + 1.0e-20f);
+  }
+}
+
+std::string Sweep::finish(double seconds)
+{
+  std::unique_lock <std::mutex> lock(mutex);
+  std::string result;
+  char buf[64];
+
+  // Wait for all workers to finish
+  cond.wait(lock, [this] { return(jobs.empty() && !busy); });
+
+  // Only report bins within requested range
+  unsigned int bins = std::min((size_t)ceil((stopFreq - startFreq) / binWidth), spectrum.size());
+  double span = (stopFreq - startFreq) / 1000000.0;
+
+  snprintf(buf, sizeof(buf), "start=%.0f bin=%.3f bins=%u rate=%.2fMHz/s\n",
+    startFreq, binWidth, bins, seconds>0.0? span/seconds : 0.0
+  );
+  result = buf;
+
+  for(unsigned int j=0 ; j<bins ; ++j)
+  {
+    snprintf(buf, sizeof(buf), j? ",%.1f" : "%.1f", spectrum[j]);
+    result += buf;
+  }
+
+  return(result + "\n");
+}
@@ -0,0 +1,84 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include "FFT.hpp"
+#include "RealTime.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Sweep
+{
+  public:
+    Sweep(unsigned int workers = 0, const RealTime *rt = 0);
+      // Create given number of workers, 0 for one per core, optionally
+      // applying given scheduling to them.
+
+    ~Sweep();
+
+    unsigned int getWorkerCount() const { return(workers.size()); }
+      // Get number of worker threads.
+
+    bool plan(double startFreq, double stopFreq, double binWidth, unsigned int rate, unsigned int averages = 8, unsigned int align = 1);
+      // Plan sweep over given range with given resolution, capture
+      // size will be a multiple of ALIGN.
+
+    unsigned int getStepCount() const { return(stepCount); }
+      // Get number of sweep steps.
+
+    double getStepFrequency(unsigned int step) const;
+      // Get center frequency to tune to for given step.
+
+    unsigned int getCaptureSize() const { return(captureSize); }
+      // Get number of samples to capture per step.
+
+    short *getBuffer();
+      // Get free capture buffer, waiting for workers if necessary.
+
+    void submit(unsigned int step, short *buffer);
+      // Queue captured samples for processing.
+
+    std::string finish(double seconds);
+      // Wait for all steps and return the stitched spectrum.
+
+  private:
+    struct Job
+    {
+      unsigned int step;
+      short *buffer;
+    };
+
+    std::vector<std::thread> workers;
+    const RealTime *rt;
+    std::vector<std::vector<short>> buffers;
+    std::vector<short *> freeBuffers;
+    std::deque<Job> jobs;
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned int busy = 0;
+    bool stopping = false;
+
+    std::vector<float> window;
+    float windowGain = 1.0f;
+    std::vector<float> spectrum;
+    double startFreq = 0.0;
+    double stopFreq  = 0.0;
+    double binWidth  = 0.0;
+    unsigned int fftSize   = 0;
+    unsigned int usable    = 0;
+    unsigned int averages  = 0;
+    unsigned int stepCount = 0;
+    unsigned int captureSize = 0;
+
+    void work();
+      // Worker thread processing queued jobs.
+
+    void process(FFT &fft, std::vector<std::complex<float>> &data, const Job &job);
+      // Compute power spectrum for a single step.
+};
+
+#endif // SWEEP_HPP
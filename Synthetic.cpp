@@ -0,0 +1,279 @@
+#include "Synthetic.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+
+void Synthetic::Rotator::set(double hz, unsigned int rate)
+{
+  double phase = 2.0 * M_PI * hz / rate;
+  di = cos(phase);
+  dq = sin(phase);
+}
+
+void Synthetic::Rotator::normalize()
+{
+  float mag = sqrtf(i * i + q * q);
+  i /= mag;
+  q /= mag;
+}
+
+bool Synthetic::configure(const std::string &spec, bool realtime)
+{
+  std::string list = spec.empty() || (spec=="true")? "noise:-70/tone:1010000:-20" : spec;
+  double iqDB = 0.0, iqDegrees = 0.0;
+
+  components.clear();
+  dcI = dcQ = 0.0f;
+  this->realtime = realtime;
+
+  // Parse '/' separated components
+  for(size_t j=0 ; j<list.size() ; )
+  {
+    size_t k = list.find('/', j);
+    std::string item = list.substr(j, k==std::string::npos? k : k - j);
+    j = k==std::string::npos? list.size() : k + 1;
+
+    Component c;
+    char name[16];
+    double a = 0.0, b = 0.0, d = 0.0;
+    int n = sscanf(item.c_str(), "%15[a-z]:%lf:%lf:%lf", name, &a, &b, &d);
+
+    if((n>=3) && !strcmp(name, "tone"))
+    { c.type = TYPE_TONE;c.frequency = a;c.level = b;c.param = 0.0; }
+    else if((n>=4) && !strcmp(name, "am"))
+    { c.type = TYPE_AM;c.frequency = a;c.level = b;c.param = d; }
+    else if((n>=4) && !strcmp(name, "ssb"))
+    { c.type = TYPE_SSB;c.frequency = a;c.level = b;c.param = d; }
+    else if((n>=2) && !strcmp(name, "noise"))
+    { c.type = TYPE_NOISE;c.frequency = 0.0;c.level = a;c.param = 0.0; }
+    else if((n>=3) && !strcmp(name, "impulse"))
+    { c.type = TYPE_IMPULSE;c.frequency = 0.0;c.level = b;c.param = a; }
+    else if((n>=3) && !strcmp(name, "dc"))
+    { dcI = a;dcQ = b;continue; }
+    else if((n>=3) && !strcmp(name, "iq"))
+    { iqDB = a;iqDegrees = b;continue; }
+    else
+    {
+      fprintf(stderr, "Synthetic::configure(): Invalid component '%s'!\n", item.c_str());
+      return(false);
+    }
+
+    components.push_back(c);
+  }
+
+  iqGain  = pow(10.0, iqDB / 20.0);
+  iqPhase = iqDegrees * M_PI / 180.0;
+
+  // Gaussian noise is looked up, not computed per sample
+  if(noise.empty())
+  {
+    noise.resize(NOISE_SIZE);
+    for(unsigned int j=0 ; j<NOISE_SIZE ; j+=2)
+    {
+      double u = (random() + 1.0) / 4294967296.0;
+      double v = random() / 4294967296.0;
+      double r = sqrt(-2.0 * log(u));
+      noise[j]     = r * cos(2.0 * M_PI * v);
+      noise[j + 1] = r * sin(2.0 * M_PI * v);
+    }
+  }
+
+  update();
+  return(true);
+}
+
+void Synthetic::tune(double frequency, double gain)
+{
+  this->frequency = frequency;
+  this->gain      = gain;
+  update();
+}
+
+void Synthetic::update()
+{
+  if(!rate) return;
+
+  for(auto &c: components)
+  {
+    double offset = c.frequency - frequency;
+
+    c.amplitude = pow(10.0, (c.level + gain) / 20.0);
+
+    // Signals outside the receiver passband do not get through
+    if((c.type!=TYPE_NOISE) && (c.type!=TYPE_IMPULSE) && (fabs(offset) > 0.45 * rate))
+      c.amplitude = 0.0f;
+
+    switch(c.type)
+    {
+      case TYPE_TONE:
+        c.carrier.set(offset, rate);
+        break;
+      case TYPE_AM:
+        c.carrier.set(offset, rate);
+        c.tone.set(c.param, rate);
+        break;
+      case TYPE_SSB:
+        c.tone.set(offset + c.param, rate);
+        c.tone2.set(offset + 2.5 * c.param, rate);
+        break;
+    }
+  }
+}
+
+bool Synthetic::open(const char *deviceName, unsigned int rate, unsigned int bufferSize, unsigned int periodSize)
+{
+  close();
+
+  this->rate = rate;
+  period     = periodSize;
+  work.resize(2 * period);
+  generated  = 0;
+  startTime  = Metrics::now();
+  opened     = true;
+
+  update();
+  return(true);
+}
+
+void Synthetic::close()
+{
+  opened = false;
+}
+
+unsigned int Synthetic::getAvail() const
+{
+  if(!opened || !realtime) return(0);
+
+  // Samples that real hardware would have captured by now
+  unsigned long long due = (Metrics::now() - startTime) * rate / 1000000;
+  return(due > generated? due - generated : 0);
+}
+
+unsigned int Synthetic::read(void *data, unsigned int samples)
+{
+  short *out = (short *)data;
+  float ci = cosf(iqPhase), si = sinf(iqPhase);
+
+  if(!opened || !period) return(0);
+
+  // Keep pace with the sample rate, if asked to
+  if(realtime)
+  {
+    unsigned long long due = startTime + (generated + samples) * 1000000ULL / rate;
+    unsigned long long now = Metrics::now();
+    if(due > now) usleep(due - now);
+  }
+
+  for(unsigned int j=0 ; j<samples ; j+=period)
+  {
+    unsigned int n = std::min(period, samples - j);
+    float *w = work.data();
+
+    std::fill(w, w + 2 * n, 0.0f);
+
+    for(auto &c: components)
+    {
+      float a = c.amplitude;
+      if(a==0.0f) continue;
+
+      switch(c.type)
+      {
+        case TYPE_TONE:
+          for(unsigned int k=0 ; k<n ; ++k)
+          {
+            w[2 * k]     += a * c.carrier.i;
+            w[2 * k + 1] += a * c.carrier.q;
+            c.carrier.step();
+          }
+          break;
+
+        case TYPE_AM:
+          for(unsigned int k=0 ; k<n ; ++k)
+          {
+            float e = a * (1.0f + 0.8f * c.tone.i) / 1.8f;
+            w[2 * k]     += e * c.carrier.i;
+            w[2 * k + 1] += e * c.carrier.q;
+            c.carrier.step();
+            c.tone.step();
+          }
+          break;
+
+        case TYPE_SSB:
+          for(unsigned int k=0 ; k<n ; ++k)
+          {
+            w[2 * k]     += 0.5f * a * (c.tone.i + c.tone2.i);
+            w[2 * k + 1] += 0.5f * a * (c.tone.q + c.tone2.q);
+            c.tone.step();
+            c.tone2.step();
+          }
+          break;
+
+        case TYPE_NOISE:
+          a *= (float)M_SQRT1_2;
+          for(unsigned int k=0 ; k<2*n ; ++k)
+            w[k] += a * noise[random() & (NOISE_SIZE - 1)];
+          break;
+
+        case TYPE_IMPULSE:
+          for(unsigned int k=0 ; k<n ; ++k)
+          {
+            impulsePhase += c.param / rate;
+            if(impulsePhase < 1.0) continue;
+            impulsePhase -= 1.0;
+
+            float s = random() & 1? a : -a;
+            for(unsigned int i=k ; (i<k+4) && (i<n) ; ++i)
+            {
+              w[2 * i]     += s;
+              w[2 * i + 1] -= s;
+            }
+          }
+          break;
+      }
+
+      c.carrier.normalize();
+      c.tone.normalize();
+      c.tone2.normalize();
+    }
+
+    // Add ADC errors, then convert to CS16 clipping at full scale
+    for(unsigned int k=0 ; k<n ; ++k)
+    {
+      float i = (w[2 * k] + dcI) * 32768.0f;
+      float q = (iqGain * (w[2 * k + 1] * ci + w[2 * k] * si) + dcQ) * 32768.0f;
+      out[2 * (j + k)]     = (short)std::max(-32768.0f, std::min(i, 32767.0f));
+      out[2 * (j + k) + 1] = (short)std::max(-32768.0f, std::min(q, 32767.0f));
+    }
+  }
+
+  generated += samples;
+  if(metrics) metrics->count(Metrics::FRAMES_CAPTURED, samples);
+  return(samples);
+}
+
+std::string Synthetic::getStatus() const
+{
+  static const char *typeNames[] = { "tone", "am", "ssb", "noise", "impulse" };
+  std::string result;
+  char buf[256];
+
+  for(auto &c: components)
+  {
+    snprintf(buf, sizeof(buf), "%s: %.0fHz %.1fdBFS%s\n",
+      typeNames[c.type], c.frequency, c.level, c.amplitude==0.0f? " (out of band)" : ""
+    );
+    result += buf;
+  }
+
+  unsigned long long elapsed = opened? Metrics::now() - startTime : 0;
+  snprintf(buf, sizeof(buf), "dc=%.4f,%.4f\niqGain=%.3f\niqPhase=%.2fdeg\nrealtime=%s\ngenerated=%llu\nthroughput=%.3fMS/s\n",
+    dcI, dcQ, iqGain, iqPhase * 180.0 / M_PI, realtime? "true" : "false",
+    generated, elapsed? (double)generated / elapsed : 0.0
+  );
+
+  return(result + buf);
+}
@@ -0,0 +1,113 @@
+#ifndef SYNTHETIC_HPP
+#define SYNTHETIC_HPP
+
+#include "ALSA.hpp"
+#include <string>
+#include <vector>
+
+class Synthetic: public ALSA
+{
+  public:
+    static const unsigned int NOISE_SIZE = 65536;
+      // Precomputed gaussian noise table size, a power of two.
+
+    Synthetic() { configure(""); }
+    ~Synthetic() { close(); }
+
+    bool configure(const std::string &spec, bool realtime = false);
+      // Set signals to generate, as a list of '/' separated components:
+      //   tone:HZ:DBFS             - carrier
+      //   am:HZ:DBFS:TONEHZ        - carrier AM modulated by a tone
+      //   ssb:HZ:DBFS:TONEHZ       - USB two-tone test at TONEHZ, 2.5*TONEHZ
+      //   noise:DBFS               - gaussian noise
+      //   impulse:PERSEC:DBFS      - 4 sample impulses
+      //   dc:I:Q                   - DC offset, fraction of full scale
+      //   iq:DB:DEGREES            - Q gain and phase imbalance
+      // Frequencies are absolute, signal levels are at 0dB gain. Samples
+      // are generated as fast as they are read, unless REALTIME is set.
+
+    void tune(double frequency, double gain);
+      // Follow receiver tuning and gain in dB, as hardware would. Not
+      // thread safe, callers serialize it with read().
+
+    bool open(const char *deviceName, unsigned int rate, unsigned int bufferSize, unsigned int periodSize);
+    void close();
+    bool isOpen() const { return(opened); }
+    unsigned int read(void *data, unsigned int samples);
+    unsigned int getChunkSize() const { return(period); }
+    unsigned int getAvail() const;
+      // Same as ALSA, generating samples instead of capturing them.
+
+    std::string getStatus() const;
+      // Print components and generation statistics, one per line.
+
+  private:
+    enum Type
+    {
+      TYPE_TONE = 0,
+      TYPE_AM,
+      TYPE_SSB,
+      TYPE_NOISE,
+      TYPE_IMPULSE
+    };
+
+    struct Rotator
+    {
+      float i = 1.0f, q = 0.0f;       // Current phasor
+      float di = 1.0f, dq = 0.0f;     // Increment per sample
+
+      void set(double hz, unsigned int rate);
+      inline void step()
+      {
+        float ni = i * di - q * dq;
+        q = i * dq + q * di;
+        i = ni;
+      }
+      void normalize();
+    };
+
+    struct Component
+    {
+      unsigned int type;
+      double frequency;               // Absolute frequency, Hz
+      double level;                   // Level at 0dB gain, dBFS
+      double param;                   // Modulation tone or impulse rate
+      float amplitude = 0.0f;         // Current amplitude, after gain
+      Rotator carrier;
+      Rotator tone;
+      Rotator tone2;
+    };
+
+    std::vector<Component> components;
+    float dcI = 0.0f, dcQ = 0.0f;     // DC offset
+    float iqGain = 1.0f;              // Q channel gain
+    float iqPhase = 0.0f;             // Q channel phase skew, radians
+    bool realtime = false;
+
+    double frequency = 0.0;
+    double gain = 0.0;
+    unsigned int rate = 0;
+    unsigned int period = 0;
+    bool opened = false;
+
+    std::vector<float> noise;
+    std::vector<float> work;
+    unsigned int seed = 1;
+    double impulsePhase = 0.0;
+    unsigned long long generated = 0;
+    unsigned long long startTime = 0;
+
+    void update();
+      // Recompute oscillators and amplitudes after tuning changes.
+
+    inline unsigned int random()
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      return(seed);
+    }
+      // Xorshift random number.
+};
+
+#endif // SYNTHETIC_HPP
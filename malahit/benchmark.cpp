@@ -0,0 +1,247 @@
+#include "benchmark.hpp"
+#include "CRC16.hpp"
+#include "IQCodec.hpp"
+#include "Kernels.hpp"
+#include "STM.hpp"
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Formats.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <complex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+static thread_local bool countAllocs = false;
+static thread_local unsigned long long allocCount = 0;
+
+//
+// Count heap allocations made by the calling thread while countAllocs
+// is set. Replacing operator new is fine in this executable, it must
+// never be done in the driver module. Kept out of line, or GCC warns
+// about free() on memory it assumes came from the builtin new.
+//
+__attribute__((noinline)) void *operator new(size_t size)
+{
+  if(countAllocs) allocCount++;
+  void *result = malloc(size? size : 1);
+  if(!result) throw std::bad_alloc();
+  return(result);
+}
+
+__attribute__((noinline)) void operator delete(void *data) noexcept { free(data); }
+__attribute__((noinline)) void operator delete(void *data, size_t size) noexcept { free(data); }
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec + ts.tv_nsec / 1000000000.0);
+}
+
+static bool benchCRC16()
+{
+  const unsigned int size = STM::FIRMWARE_SIZE;
+  const unsigned int runs = 8;
+  unsigned char *data = new unsigned char[size];
+  unsigned short crc1 = 0xFFFF;
+  unsigned short crc2 = 0xFFFF;
+  double t0, t1, t2;
+  bool result = true;
+
+  for(unsigned int j=0 ; j<size ; ++j) data[j] = rand();
+
+  // Check parity on all small lengths and alignments
+  for(unsigned int j=0 ; (j<8) && result ; ++j)
+    for(unsigned int i=0 ; (i<512) && result ; ++i)
+      if(CRC16::compute(data + j, i) != CRC16::computeBitwise(data + j, i))
+      {
+        fprintf(stderr, "CRC16: Mismatch at offset %u, length %u!\n", j, i);
+        result = false;
+      }
+
+  // Time whole firmware image, chaining results so nothing gets optimized out
+  t0 = now();
+  for(unsigned int j=0 ; j<runs ; ++j) crc1 = CRC16::computeBitwise(data, size, crc1);
+  t1 = now();
+  for(unsigned int j=0 ; j<runs ; ++j) crc2 = CRC16::compute(data, size, crc2);
+  t2 = now();
+
+  if(crc1 != crc2)
+  {
+    fprintf(stderr, "CRC16: Image CRC mismatch 0x%04X <> 0x%04X!\n", crc1, crc2);
+    result = false;
+  }
+
+  printf("CRC16: bitwise %.1fMB/s, slice-by-8 %.1fMB/s, speedup %.1fx %s\n",
+    runs * size / (t1 - t0) / 1e6,
+    runs * size / (t2 - t1) / 1e6,
+    (t1 - t0) / (t2 - t1),
+    result? "OK" : "FAILED"
+  );
+
+  delete [] data;
+  return(result);
+}
+
+static bool benchIQCodec(const char *name, const short *data, unsigned int samples)
+{
+  const unsigned int block = 3072;
+  std::vector<unsigned char> encoded(IQCodec::getMaxSize(block) * (samples / block + 1));
+  std::vector<short> decoded(2 * block);
+  std::vector<size_t> sizes;
+  size_t total = 0;
+  double t0, t1, t2;
+  bool result = true;
+
+  // Encode in driver-sized blocks
+  t0 = now();
+  for(unsigned int j=0 ; j<samples ; j+=block)
+  {
+    size_t size = IQCodec::encode(data + 2 * j, std::min(block, samples - j), encoded.data() + total);
+    sizes.push_back(size);
+    total += size;
+  }
+  t1 = now();
+
+  // Decode and compare
+  size_t offset = 0;
+  for(unsigned int j=0, i=0 ; j<samples ; j+=block, ++i)
+  {
+    unsigned int n = std::min(block, samples - j);
+    if((IQCodec::decode(encoded.data() + offset, sizes[i], decoded.data(), block)!=n)
+    || memcmp(decoded.data(), data + 2 * j, n * 2 * sizeof(short)))
+    {
+      fprintf(stderr, "IQCodec: Mismatch in %s block %u!\n", name, i);
+      result = false;
+      break;
+    }
+    offset += sizes[i];
+  }
+  t2 = now();
+
+  printf("IQCodec %s: ratio %.2f, encode %.1fMS/s, decode+compare %.1fMS/s %s\n",
+    name, samples * 4.0 / total, samples / (t1 - t0) / 1e6, samples / (t2 - t1) / 1e6,
+    result? "OK" : "FAILED"
+  );
+
+  return(result);
+}
+
+static bool benchIQCodec(const char *captureFile)
+{
+  bool result = true;
+
+  // Time on a real capture, if given
+  if(captureFile)
+  {
+    FILE *f = fopen(captureFile, "rb");
+    if(!f)
+    {
+      fprintf(stderr, "IQCodec: Cannot open '%s'!\n", captureFile);
+      return(false);
+    }
+
+    std::vector<short> data;
+    short buf[8192];
+    size_t n;
+    while((n = fread(buf, sizeof(short), 8192, f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    return(benchIQCodec(captureFile, data.data(), data.size() / 2));
+  }
+
+  // Otherwise, tone in noise at levels from quiet HF to full scale
+  const unsigned int samples = 912000;
+  const int levels[] = { 8, 64, 1024, 16384 };
+  std::vector<short> data(2 * samples);
+  char name[32];
+
+  for(unsigned int l=0 ; l<sizeof(levels)/sizeof(levels[0]) ; ++l)
+  {
+    for(unsigned int j=0 ; j<samples ; ++j)
+    {
+      data[2*j]   = levels[l] * (0.5 * cos(j * 0.01) + (rand() / (double)RAND_MAX - 0.5));
+      data[2*j+1] = levels[l] * (0.5 * sin(j * 0.01) + (rand() / (double)RAND_MAX - 0.5));
+    }
+
+    snprintf(name, sizeof(name), "level %d", levels[l]);
+    result &= benchIQCodec(name, data.data(), samples);
+  }
+
+  return(result);
+}
+
+static bool benchKernels()
+{
+  // Self-test checks every variant this CPU runs against scalar code
+  bool result = Kernels::selfTest() && Kernels::select("auto");
+  printf("Kernels: %s%s", result? "OK\n" : "FAILED\n", Kernels::getStatus().c_str());
+  return(result);
+}
+
+static bool benchReadStream()
+{
+  const unsigned int reads = 1000;
+  SoapySDR::Device *device = 0;
+
+  // Synthetic unit exercises the whole capture path without hardware
+  try
+  {
+    device = SoapySDR::Device::make(SoapySDR::KwargsFromString("driver=malahitrr,synthetic=noise:-60/tone:1010000:-20"));
+  }
+  catch(const std::exception &e)
+  {
+    printf("readStream: skipped, %s\n", e.what());
+    return(true);
+  }
+
+  std::vector<std::complex<float>> buf(4096);
+  void *buffs[] = { buf.data() };
+  int flags;
+  long long timeNs;
+  unsigned long long samples = 0;
+
+  SoapySDR::Stream *stream = device->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CF32, {}, {{ "dsp", "dc,decimate" }, { "decimation", "2" }});
+  device->activateStream(stream);
+
+  // First reads set things up, only count steady state
+  for(unsigned int j=0 ; j<8 ; ++j) device->readStream(stream, buffs, buf.size(), flags, timeNs);
+
+  double t0 = now();
+  for(unsigned int j=0 ; j<reads ; ++j)
+  {
+    countAllocs = true;
+    int n = device->readStream(stream, buffs, buf.size(), flags, timeNs);
+    countAllocs = false;
+    if(n>0) samples += n;
+  }
+  double t1 = now();
+
+  device->deactivateStream(stream);
+  device->closeStream(stream);
+  SoapySDR::Device::unmake(device);
+
+  printf("readStream: %llu allocations in %u reads, %.1fMS/s %s\n",
+    allocCount, reads, samples / (t1 - t0) / 1e6, allocCount? "FAILED" : "OK"
+  );
+
+  return(!allocCount);
+}
+
+int runBenchmarks(const char *captureFile)
+{
+  bool result = true;
+
+  result &= benchCRC16();
+  result &= benchIQCodec(captureFile);
+  result &= benchKernels();
+  result &= benchReadStream();
+
+  return(result? 0 : 1);
+}
@@ -0,0 +1,10 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+int runBenchmarks(const char *captureFile = 0);
+  // Check and time optimized routines against reference code. IQ codec
+  // is timed on given raw CS16 capture, or on synthetic signals. SIMD
+  // kernels are checked in every variant the CPU supports, and readStream()
+  // on a synthetic unit must not allocate.
+
+#endif // BENCHMARK_HPP
@@ -0,0 +1,51 @@
+#include "daemon.hpp"
+
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Types.hpp>
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int signal)
+{
+  stopRequested = 1;
+}
+
+int runDaemon(const char *name, const char *args)
+{
+  SoapySDR::Kwargs deviceArgs = SoapySDR::KwargsFromString(args? args : "");
+  SoapySDR::Device *device = 0;
+
+  // The driver captures by itself while serving the ring
+  deviceArgs["driver"]   = "malahitrr";
+  deviceArgs["shmServe"] = name;
+
+  try
+  {
+    device = SoapySDR::Device::make(deviceArgs);
+  }
+  catch(const std::exception &e)
+  {
+    fprintf(stderr, "runDaemon(): %s\n", e.what());
+  }
+
+  if(!device)
+  {
+    fprintf(stderr, "runDaemon(): Failed opening Malahit device!\n");
+    return(1);
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  fprintf(stderr, "runDaemon(): Serving '%s', attach with \"driver=malahitrr,shm=%s\".\n", name, name);
+
+  while(!stopRequested) sleep(1);
+
+  fprintf(stderr, "runDaemon(): Stopping...\n");
+  SoapySDR::Device::unmake(device);
+  return(0);
+}
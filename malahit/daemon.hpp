@@ -0,0 +1,8 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+int runDaemon(const char *name, const char *args = 0);
+  // Own the receiver and serve it to other processes via shared
+  // memory ring NAME until interrupted. ARGS are extra device args.
+
+#endif // DAEMON_HPP
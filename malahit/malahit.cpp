@@ -1,14 +1,24 @@
 #include "STM.hpp"
 #include "GPIO.hpp"
+#include "benchmark.hpp"
+#include "daemon.hpp"
 
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 
-STM stmDevice;
-
 int main(int argc, char *argv[])
 {
+  // Benchmarks do not need hardware
+  if((argc>=2) && !strcmp(argv[1], "-b"))
+    return(runBenchmarks(argc>=3? argv[2] : 0));
+
+  // Daemon opens hardware through the driver
+  if((argc>=3) && !strcmp(argv[1], "-s"))
+    return(runDaemon(argv[2], argc>=4? argv[3] : 0));
+
+  STM stmDevice;
+
   // Hard-reset STM chip
   if(!stmDevice.reset())
   {
@@ -31,9 +41,19 @@ int main(int argc, char *argv[])
         }
         break;
 
+      case 'v': // Verify firmware
+        if(!stmDevice.verifyFirmware(argv[2]))
+        {
+          fprintf(stderr, "%s: STM firmware does not match '%s'\n", argv[0], argv[2]);
+          printf("FW-ERROR\n");
+          return(3);
+        }
+        break;
+
       case 'w': // Update firmware
       case 'f': // Force firmware update
-        if(!stmDevice.updateFirmware(argv[2], argv[1][1]=='f'))
+      case 'd': // Force firmware update, changed pages only
+        if(!stmDevice.updateFirmware(argv[2], argv[1][1]!='w', argv[1][1]=='d'))
         {
           fprintf(stderr, "%s: Failed to update STM firmware\n", argv[0]);
           printf("FW-ERROR\n");